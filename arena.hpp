@@ -0,0 +1,102 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// constants
+
+constexpr uint64_t ARENA_MIN_CHUNK = 4096;
+
+// data structures
+
+// bump allocator for trivially destructible objects. Chunks are only released
+// together with the arena, so everything allocated stays put while it lives
+class Arena {
+private:
+    std::vector<std::unique_ptr<std::byte[]>> chunks;
+    std::byte* ptr = nullptr;
+    std::byte* end = nullptr;
+    uint64_t capacity = 0;
+
+    template <typename T>
+    std::byte* aligned() const {
+        uintptr_t addr = reinterpret_cast<uintptr_t>(ptr);
+        uintptr_t mask = alignof(T) - 1;
+        return ptr + (((addr + mask) & ~mask) - addr);
+    }
+
+public:
+    Arena() = default;
+
+    Arena(Arena&& other) noexcept
+        : chunks(std::move(other.chunks)),
+          ptr(std::exchange(other.ptr, nullptr)),
+          end(std::exchange(other.end, nullptr)),
+          capacity(std::exchange(other.capacity, 0)) {}
+
+    Arena& operator=(Arena&& other) noexcept {
+        chunks = std::move(other.chunks);
+        ptr = std::exchange(other.ptr, nullptr);
+        end = std::exchange(other.end, nullptr);
+        capacity = std::exchange(other.capacity, 0);
+        return *this;
+    }
+
+    // the next bytes allocated come from a single chunk, so anything sized up
+    // front costs one allocation
+    void reserve(uint64_t bytes) {
+        if (static_cast<uint64_t>(end - ptr) >= bytes) return;
+
+        bytes = std::max(bytes, ARENA_MIN_CHUNK);
+        chunks.push_back(std::make_unique_for_overwrite<std::byte[]>(bytes));
+        ptr = chunks.back().get();
+        end = ptr + bytes;
+        capacity += bytes;
+    }
+
+    // bytes held in chunks, used or not
+    uint64_t bytes() const {
+        return capacity;
+    }
+
+    // uninitialized storage for n objects
+    template <typename T>
+    T* allocate(uint64_t n) {
+        static_assert(std::is_trivially_destructible_v<T>);
+        uint64_t bytes = n * sizeof(T);
+
+        std::byte* res = aligned<T>();
+        if (static_cast<uint64_t>(end - res) < bytes) {
+            reserve(bytes + alignof(T));
+            res = aligned<T>();
+        }
+
+        ptr = res + bytes;
+        return reinterpret_cast<T*>(res);
+    }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        return new (allocate<T>(1)) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    std::span<T> copy(std::span<const T> values) {
+        T* res = allocate<T>(values.size());
+        std::uninitialized_copy(values.begin(), values.end(), res);
+        return {res, values.size()};
+    }
+
+    // bytes to reserve for n objects of T, padding included
+    template <typename T>
+    static constexpr uint64_t bytesFor(uint64_t n) {
+        return n * sizeof(T) + alignof(T);
+    }
+};
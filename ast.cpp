@@ -0,0 +1,478 @@
+#include "ast.hpp"
+
+#include <algorithm>
+
+Ast::Ast(Postfix&& postfix) : classes(std::move(postfix.classes)) {
+    // simplification adds nodes, the arena grows in chunks if it runs out
+    uint64_t numTokens = postfix.tokens.size();
+    arena.reserve(Arena::bytesFor<AstNode>(2 * numTokens) +
+                  Arena::bytesFor<AstNode*>(4 * numTokens));
+
+    std::vector<AstNode*>& stk = scratch;
+
+    for (auto [type, c, first, count] : postfix.tokens) {
+        if (type == Type::LITERAL || type == Type::DOT) {
+            stk.push_back(makeNode(type, c));
+        }
+        else if (type == Type::CLASS) {
+            AstNode* node = makeNode(type);
+            node->first = first;
+            node->count = count;
+            stk.push_back(node);
+        }
+        else if (type == Type::CONCAT || type == Type::UNION) {
+            AstNode* right = stk.back();
+            stk.pop_back();
+            stk.back() = makeNode(type, {stk.back(), right});
+        }
+        else {
+            AstNode* node = makeNode(type, {stk.back()});
+            node->first = first;
+            node->count = count;
+            stk.back() = node;
+        }
+    }
+
+    if (!stk.empty()) root = stk.back();
+    stk.clear();
+}
+
+// structural equality
+
+uint64_t Ast::hash(const AstNode* node) const {
+    uint64_t res = static_cast<uint64_t>(node->type);
+
+    auto mix = [&res](uint64_t value) {
+        res ^= value + 0x9E3779B97F4A7C15ULL + (res << 6) + (res >> 2);
+    };
+
+    if (node->type == Type::LITERAL) mix(node->c);
+
+    for (auto [l, r] : ranges(node)) {
+        mix(l);
+        mix(r);
+    }
+
+    for (const AstNode* child : node->children) mix(hash(child));
+    return res;
+}
+
+bool Ast::equal(const AstNode* a, const AstNode* b) const {
+    if (a == b) return true;
+    if (a->type != b->type || a->c != b->c) return false;
+    if (!std::ranges::equal(ranges(a), ranges(b))) return false;
+
+    return std::ranges::equal(a->children, b->children, [this](const AstNode* x, const AstNode* y) {
+        return equal(x, y);
+    });
+}
+
+// simplification passes
+
+// simplified operands of a CONCAT or UNION with nested operators of the same
+// type flattened, pushed onto scratch. Parsing leaves left-leaning chains
+// like ((a|b)|c)|d, walked here without recursing once per link
+void Ast::collectOperands(AstNode* node) {
+    std::vector<AstNode*> pending(node->children.rbegin(), node->children.rend());
+
+    while (!pending.empty()) {
+        AstNode* child = pending.back();
+        pending.pop_back();
+
+        if (child->type == node->type && !isEmpty(child)) {
+            pending.insert(pending.end(), child->children.rbegin(), child->children.rend());
+        }
+        else scratch.push_back(simplify(child));
+    }
+}
+
+AstNode* Ast::simplify(AstNode* node) {
+    // a whole chain is simplified at once, not once per link
+    if (node->type == Type::CONCAT || node->type == Type::UNION) {
+        uint64_t base = scratch.size();
+        collectOperands(node);
+        node->children = popChildren(base);
+
+        if (node->type == Type::CONCAT) return simplifyConcat(node);
+        return simplifyUnion(node);
+    }
+
+    for (AstNode*& child : node->children) child = simplify(child);
+
+    if (isQuantifier(node)) return simplifyQuantifier(node);
+    if (isRepeat(node)) return simplifyRepeat(node);
+    return node;
+}
+
+AstNode* Ast::simplifyQuantifier(AstNode* node) {
+    AstNode* child = node->children[0];
+
+    // ()* = ()
+    if (isEmpty(child)) return child;
+
+    // x**, (x+)?, (x?)+, ... stacking the same quantifier changes nothing,
+    // any two different ones make x*
+    if (isQuantifier(child)) {
+        if (child->type == node->type) return child;
+
+        // the child may be shared, rewrite this node instead
+        node->type = Type::STAR;
+        node->children = child->children;
+    }
+
+    return node;
+}
+
+AstNode* Ast::simplifyRepeat(AstNode* node) {
+    AstNode* child = node->children[0];
+    auto [min, max] = classes[node->first];
+
+    // (){n,m} = x{0} = ()
+    if (isEmpty(child) || max == 0) return makeEmpty();
+    if (min == 1 && max == 1) return child;
+
+    // x*{n,m} = x*
+    if (child->type == Type::STAR) return child;
+
+    // bounds that match a plain quantifier
+    if (max == REPEAT_INF && min <= 1) node->type = min ? Type::PLUS : Type::STAR;
+    else if (min == 0 && max == 1) node->type = Type::QUESTION;
+    else return node;
+
+    node->count = 0;
+    return simplifyQuantifier(node);
+}
+
+AstNode* Ast::simplifyConcat(AstNode* node) {
+    uint64_t base = scratch.size();
+
+    for (AstNode* child : node->children) {
+        if (child->type != Type::CONCAT) {
+            // x*x* = x*
+            if (scratch.size() > base && child->type == Type::STAR &&
+                    equal(child, scratch.back())) {
+                continue;
+            }
+            scratch.push_back(child);
+        }
+        else scratch.insert(scratch.end(), child->children.begin(), child->children.end());
+    }
+
+    if (scratch.size() - base == 1) {
+        AstNode* res = scratch.back();
+        scratch.pop_back();
+        return res;
+    }
+
+    node->children = popChildren(base);
+    return node;
+}
+
+AstNode* Ast::simplifyUnion(AstNode* node) {
+    uint64_t base = scratch.size();
+    bool nullable = false;
+
+    for (AstNode* child : node->children) {
+        if (child->type == Type::UNION) {
+            scratch.insert(scratch.end(), child->children.begin(), child->children.end());
+        }
+        else if (isEmpty(child)) nullable = true;
+        else scratch.push_back(child);
+    }
+
+    // duplicate alternatives, different ones that happen to collide are
+    // both kept
+    seen.clear();
+    auto unique = std::remove_if(scratch.begin() + base, scratch.end(), [this](AstNode* child) {
+        auto [it, inserted] = seen.try_emplace(hash(child), reinterpret_cast<uint64_t>(child));
+        return !inserted && equal(child, reinterpret_cast<AstNode*>(it->second));
+    });
+    scratch.erase(unique, scratch.end());
+
+    node->children = popChildren(base);
+    factorPrefixes(node);
+    factorSuffixes(node);
+    mergeSingleChars(node);
+
+    if (node->children.empty()) return makeEmpty();
+
+    AstNode* res = node->children.size() == 1 ? node->children[0] : node;
+    if (!nullable) return res;
+
+    // (|x) = x?
+    return simplifyQuantifier(makeNode(Type::QUESTION, {res}));
+}
+
+// everything after the first element of a sequence
+AstNode* Ast::rest(AstNode* node) {
+    if (node->type != Type::CONCAT) return makeEmpty();
+    if (node->children.size() == 2) return node->children[1];
+
+    // passes never modify children in place, so the tail can be shared
+    AstNode* res = makeNode(Type::CONCAT);
+    res->children = node->children.subspan(1);
+    return res;
+}
+
+// everything before the last element of a sequence
+AstNode* Ast::init(AstNode* node) {
+    if (node->type != Type::CONCAT) return makeEmpty();
+    if (node->children.size() == 2) return node->children[0];
+
+    AstNode* res = makeNode(Type::CONCAT);
+    res->children = node->children.first(node->children.size() - 1);
+    return res;
+}
+
+// alternatives grouped by an element, in order of appearance, or nothing
+// when no two of them share it
+std::vector<std::vector<AstNode*>> Ast::groupBy(AstNode* node, AstNode* (*elementOf)(AstNode*)) {
+    // most unions have nothing to factor, find that out without allocating
+    seen.clear();
+    bool shared = false;
+
+    for (AstNode* child : node->children) {
+        AstNode* element = elementOf(child);
+        auto [it, inserted] = seen.try_emplace(hash(element), reinterpret_cast<uint64_t>(element));
+        if (!inserted && equal(element, reinterpret_cast<AstNode*>(it->second))) {
+            shared = true;
+            break;
+        }
+    }
+
+    if (!shared) return {};
+
+    // group index by element hash, collisions start a group of their own
+    std::vector<std::vector<AstNode*>> groups;
+    seen.clear();
+
+    for (AstNode* child : node->children) {
+        AstNode* element = elementOf(child);
+        auto [it, inserted] = seen.try_emplace(hash(element), groups.size());
+
+        if (inserted || !equal(element, elementOf(groups[it->second][0]))) {
+            groups.push_back({child});
+        }
+        else groups[it->second].push_back(child);
+    }
+
+    return groups;
+}
+
+// ab|ac|d -> a(b|c)|d, applied recursively this builds a trie of the
+// alternatives so a DFA state tracks one path per distinct prefix
+void Ast::factorPrefixes(AstNode* node) {
+    auto groups = groupBy(node, firstOf);
+    if (groups.empty()) return;
+
+    uint64_t base = scratch.size();
+
+    for (const auto& group : groups) {
+        if (group.size() == 1) {
+            scratch.push_back(group[0]);
+            continue;
+        }
+
+        uint64_t suffixBase = scratch.size();
+        for (AstNode* child : group) scratch.push_back(rest(child));
+
+        AstNode* suffixes = makeNode(Type::UNION);
+        suffixes->children = popChildren(suffixBase);
+
+        AstNode* factored = makeNode(Type::CONCAT, {firstOf(group[0]), simplifyUnion(suffixes)});
+        scratch.push_back(simplifyConcat(factored));
+    }
+
+    node->children = popChildren(base);
+}
+
+// ac|bc|d -> (a|b)c|d, the alternatives then share their tails
+void Ast::factorSuffixes(AstNode* node) {
+    auto groups = groupBy(node, lastOf);
+    if (groups.empty()) return;
+
+    uint64_t base = scratch.size();
+
+    for (const auto& group : groups) {
+        if (group.size() == 1) {
+            scratch.push_back(group[0]);
+            continue;
+        }
+
+        uint64_t prefixBase = scratch.size();
+        for (AstNode* child : group) scratch.push_back(init(child));
+
+        AstNode* prefixes = makeNode(Type::UNION);
+        prefixes->children = popChildren(prefixBase);
+
+        AstNode* factored = makeNode(Type::CONCAT, {simplifyUnion(prefixes), lastOf(group[0])});
+        scratch.push_back(simplifyConcat(factored));
+    }
+
+    node->children = popChildren(base);
+}
+
+// a|[bc]|d -> [a-d]
+void Ast::mergeSingleChars(AstNode* node) {
+    uint64_t numSingles = std::count_if(node->children.begin(), node->children.end(),
+                                        isSingleChar);
+    if (numSingles < 2) return;
+
+    AstNode* merged = makeNode(Type::CLASS);
+    std::vector<ClassInterval> mergedRanges;
+    uint64_t base = scratch.size();
+    bool placed = false;
+
+    for (AstNode* child : node->children) {
+        if (!isSingleChar(child)) {
+            scratch.push_back(child);
+            continue;
+        }
+
+        // the merged class takes the place of the first single char
+        if (!placed) {
+            scratch.push_back(merged);
+            placed = true;
+        }
+
+        if (child->type == Type::DOT) {
+            merged->type = Type::DOT;
+            merged->c = '.';
+        }
+        else if (child->type == Type::LITERAL) {
+            mergedRanges.push_back({child->c, child->c});
+        }
+        else {
+            auto childRanges = ranges(child);
+            mergedRanges.insert(mergedRanges.end(), childRanges.begin(), childRanges.end());
+        }
+    }
+
+    if (merged->type == Type::CLASS) {
+        mergeIntervals(mergedRanges);
+
+        if (mergedRanges.size() == 1 && mergedRanges[0].l == mergedRanges[0].r) {
+            merged->type = Type::LITERAL;
+            merged->c = mergedRanges[0].l;
+        }
+        else {
+            merged->first = classes.size();
+            merged->count = mergedRanges.size();
+            classes.insert(classes.end(), mergedRanges.begin(), mergedRanges.end());
+        }
+    }
+
+    node->children = popChildren(base);
+}
+
+// program size
+
+uint64_t Ast::numStates(const AstNode* node) const {
+    // counts stop growing here, far past any sensible limit, so nested
+    // repetitions cannot overflow
+    constexpr uint64_t MAX_COUNT = 1ULL << 40;
+
+    uint64_t count = 0;
+
+    if (isSingleChar(node)) count = 1;
+    else if (isQuantifier(node)) count = numStates(node->children[0]) + 1;
+    else if (isRepeat(node)) {
+        uint64_t child = numStates(node->children[0]);
+        auto [min, max] = classes[node->first];
+
+        if (max == REPEAT_INF) count = min ? min * child + 1 : child + 1;
+        else count = min * child + (max - min) * (child + 1);
+    }
+    else {
+        for (const AstNode* child : node->children) count += numStates(child);
+
+        // one split per extra alternative
+        if (node->type == Type::UNION) count += node->children.size() - 1;
+    }
+
+    return std::min(count, MAX_COUNT);
+}
+
+// postfix emission
+
+void Ast::toPostfix(const AstNode* node, Postfix& res) const {
+    if (node->type == Type::LITERAL || node->type == Type::DOT) {
+        res.push(node->type, node->c);
+    }
+    else if (node->type == Type::CLASS) {
+        res.tokens.push_back({node->type, '\0', node->first, node->count});
+    }
+    else if (isRepeat(node)) repeatToPostfix(node, res);
+    else {
+        for (uint64_t i = 0; i < node->children.size(); i++) {
+            toPostfix(node->children[i], res);
+
+            // n-ary operators become a chain of binary ones, quantifiers follow their child
+            if (i || isQuantifier(node)) {
+                res.push(node->type, static_cast<char_t>(node->type));
+            }
+        }
+    }
+}
+
+// x{n,m} unrolls into n copies of x followed by m - n nested optionals
+// (x(x(x)?)?)?. Every optional copy skips straight to the end instead of
+// to the next copy as in x?x?x?, so a DFA state only ever tracks one copy
+void Ast::repeatToPostfix(const AstNode* node, Postfix& res) const {
+    const AstNode* child = node->children[0];
+    auto [min, max] = classes[node->first];
+
+    auto emit = [&res](Type type) {
+        res.push(type, static_cast<char_t>(type));
+    };
+
+    // x{n,} = x...x+, the last copy loops
+    char_t copies = (max == REPEAT_INF) ? min - 1 : min;
+
+    for (char_t i = 0; i < copies; i++) {
+        toPostfix(child, res);
+        if (i) emit(Type::CONCAT);
+    }
+
+    if (max == REPEAT_INF) {
+        toPostfix(child, res);
+        emit(Type::PLUS);
+        if (copies) emit(Type::CONCAT);
+        return;
+    }
+
+    char_t optional = max - min;
+
+    for (char_t i = 0; i < optional; i++) toPostfix(child, res);
+    for (char_t i = 0; i < optional; i++) {
+        emit(Type::QUESTION);
+        if (i + 1 < optional) emit(Type::CONCAT);
+    }
+
+    if (copies && optional) emit(Type::CONCAT);
+}
+
+Postfix Ast::toPostfix() const {
+    Postfix res;
+    res.classes = classes;
+    res.tokens.reserve(2 * numStates());
+    if (root) toPostfix(root, res);
+    return res;
+}
+
+Postfix simplifyPostfix(Postfix&& postfix, uint64_t maxStates) {
+    Ast ast(std::move(postfix));
+    ast.simplify();
+
+    // rejected before counted repetitions get unrolled
+    checkNfaSize(ast.numStates(), maxStates);
+
+    return ast.toPostfix();
+}
+
+void checkNfaSize(uint64_t numStates, uint64_t maxStates) {
+    if (numStates > maxStates) {
+        throw std::runtime_error("Regex needs " + std::to_string(numStates) +
+                                 " NFA states, the limit is " + std::to_string(maxStates));
+    }
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "nfa.hpp"
+
+#include <unordered_dense.h>
+
+// constants
+
+// NFA states a regex may compile to before it is rejected
+constexpr uint64_t DEFAULT_MAX_NFA_STATES = 100000;
+
+// data structures
+
+// CONCAT and UNION are n-ary, quantifiers have a single child and a
+// CONCAT without children is the empty regex. Classes and REPEAT bounds
+// refer to Ast::classes the way tokens do. Nodes and their children live
+// in the Ast arena
+struct AstNode {
+    Type type;
+    char_t c = '\0';
+    uint32_t first = 0;
+    uint32_t count = 0;
+    std::span<AstNode*> children;
+};
+
+class Ast {
+private:
+    Arena arena;
+    std::vector<ClassInterval> classes;
+    AstNode* root = nullptr;
+
+    // children being collected, nested passes push above and pop back to
+    // where they started
+    std::vector<AstNode*> scratch;
+
+    // alternatives by structural hash, reused by every union
+    ankerl::unordered_dense::map<uint64_t, uint64_t> seen;
+
+    std::span<const ClassInterval> ranges(const AstNode* node) const {
+        return {classes.data() + node->first, node->count};
+    }
+
+    AstNode* makeNode(Type type, char_t c = '\0') {
+        return arena.make<AstNode>(type, c);
+    }
+
+    AstNode* makeNode(Type type, std::initializer_list<AstNode*> children) {
+        AstNode* node = makeNode(type);
+        node->children = arena.copy(std::span<AstNode* const>(children.begin(), children.size()));
+        return node;
+    }
+
+    // moves scratch[base, end) into the arena
+    std::span<AstNode*> popChildren(uint64_t base) {
+        std::span<AstNode* const> children(scratch.data() + base, scratch.size() - base);
+        std::span<AstNode*> res = arena.copy(children);
+        scratch.resize(base);
+        return res;
+    }
+
+    AstNode* makeEmpty() {
+        return makeNode(Type::CONCAT);
+    }
+
+    static bool isEmpty(const AstNode* node) {
+        return node->type == Type::CONCAT && node->children.empty();
+    }
+
+    static bool isSingleChar(const AstNode* node) {
+        return node->type == Type::LITERAL || node->type == Type::DOT ||
+               node->type == Type::CLASS;
+    }
+
+    static bool isRepeat(const AstNode* node) {
+        return node->type == Type::REPEAT;
+    }
+
+    static bool isQuantifier(const AstNode* node) {
+        return node->type == Type::STAR || node->type == Type::PLUS ||
+               node->type == Type::QUESTION;
+    }
+
+    uint64_t hash(const AstNode* node) const;
+    bool equal(const AstNode* a, const AstNode* b) const;
+
+    static AstNode* firstOf(AstNode* node) {
+        return node->type == Type::CONCAT ? node->children.front() : node;
+    }
+
+    static AstNode* lastOf(AstNode* node) {
+        return node->type == Type::CONCAT ? node->children.back() : node;
+    }
+
+    AstNode* rest(AstNode* node);
+    AstNode* init(AstNode* node);
+    std::vector<std::vector<AstNode*>> groupBy(AstNode* node, AstNode* (*elementOf)(AstNode*));
+
+    void collectOperands(AstNode* node);
+    AstNode* simplify(AstNode* node);
+    AstNode* simplifyQuantifier(AstNode* node);
+    AstNode* simplifyRepeat(AstNode* node);
+    AstNode* simplifyConcat(AstNode* node);
+    AstNode* simplifyUnion(AstNode* node);
+    void factorPrefixes(AstNode* node);
+    void factorSuffixes(AstNode* node);
+    void mergeSingleChars(AstNode* node);
+
+    uint64_t numStates(const AstNode* node) const;
+
+    void toPostfix(const AstNode* node, Postfix& res) const;
+    void repeatToPostfix(const AstNode* node, Postfix& res) const;
+
+public:
+    Ast(Postfix&& postfix);
+
+    void simplify() {
+        if (root) root = simplify(root);
+    }
+
+    // states of the NFA built from toPostfix(), including its match state
+    uint64_t numStates() const {
+        return root && !isEmpty(root) ? numStates(root) + 1 : 0;
+    }
+
+    Postfix toPostfix() const;
+};
+
+// function declarations
+
+Postfix simplifyPostfix(Postfix&&, uint64_t maxStates = DEFAULT_MAX_NFA_STATES);
+void checkNfaSize(uint64_t numStates, uint64_t maxStates);
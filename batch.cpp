@@ -0,0 +1,63 @@
+#include "batch.hpp"
+
+static uint64_t alignChunk(uint64_t size) {
+    return (std::max(size, BATCH_ALIGN) + BATCH_ALIGN - 1) / BATCH_ALIGN * BATCH_ALIGN;
+}
+
+BatchMatcher::BatchMatcher(const std::string& pattern, bool lazy, Encoding encoding,
+                           uint32_t flags, unsigned numThreads, uint64_t chunkSize)
+    : lazy(lazy), encoding(encoding), fixedChunk(chunkSize ? alignChunk(chunkSize) : 0),
+      pool(defaultThreads(numThreads)) {
+    if (encoding != Encoding::BYTES && encoding != Encoding::UTF8) {
+        throw std::invalid_argument("Batches hold byte or utf8 candidates");
+    }
+
+    program = RegexCache::global().get({pattern, encoding, flags, !lazy});
+
+    if (lazy) {
+        for (unsigned i = 0; i < pool.size(); i++) scratch.emplace_back(program->nfa, true);
+    }
+}
+
+template <typename Get>
+const std::vector<uint64_t>& BatchMatcher::evalAll(uint64_t count, Get candidate) {
+    bits.assign((count + 63) / 64, 0);
+
+    chunk = fixedChunk;
+    if (!chunk) {
+        uint64_t even = count / (pool.size() * CHUNKS_PER_THREAD);
+        chunk = alignChunk(std::min(even, MAX_BATCH_CHUNK));
+    }
+
+    // chunks start on a word, so a chunk's bits are its own words
+    pool.run((count + chunk - 1) / chunk, [&](uint64_t c, unsigned worker) {
+        DFA& dfa = lazy ? scratch[worker] : program->dfa;
+        uint64_t begin = c * chunk;
+        uint64_t size = std::min(count, begin + chunk) - begin;
+        uint64_t* words = bits.data() + begin / 64;
+
+        if (encoding == Encoding::BYTES) {
+            dfa.evalLockstep(size, [&](uint64_t i) {return ByteView(candidate(begin + i));}, words);
+        }
+        else {
+            dfa.evalLockstep(size, [&](uint64_t i) {
+                return UTF8View(candidate(begin + i), utf8Mode);
+            }, words);
+        }
+    });
+
+    return bits;
+}
+
+const std::vector<uint64_t>& BatchMatcher::eval(std::span<const std::string_view> candidates) {
+    return evalAll(candidates.size(), [candidates](uint64_t i) {return candidates[i];});
+}
+
+const std::vector<uint64_t>& BatchMatcher::eval(std::string_view data,
+                                                std::span<const uint64_t> offsets) {
+    uint64_t count = offsets.empty() ? 0 : offsets.size() - 1;
+
+    return evalAll(count, [data, offsets](uint64_t i) {
+        return data.substr(offsets[i], offsets[i + 1] - offsets[i]);
+    });
+}
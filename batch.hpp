@@ -0,0 +1,62 @@
+#pragma once
+
+#include "cache.hpp"
+#include "pool.hpp"
+
+#include <span>
+
+// constants
+
+// a chunk holds whole words of the result bitmap, so no two workers ever
+// write the same word
+constexpr uint64_t BATCH_ALIGN = 64;
+
+// with an automatic chunk size every worker gets about this many chunks,
+// enough to even out uneven candidates by stealing
+constexpr uint64_t CHUNKS_PER_THREAD = 8;
+constexpr uint64_t MAX_BATCH_CHUNK = 16384;
+
+// data structures
+
+// one regex matched against many byte or utf8 candidates on a pool of
+// workers, each stepping its chunk with DFA::evalLockstep. An eager DFA is
+// shared, a lazy one is grown per worker on top of the shared NFA and kept
+// warm between batches
+class BatchMatcher {
+private:
+    std::shared_ptr<Program> program;
+    std::vector<DFA> scratch;
+    bool lazy = true;
+    Encoding encoding = Encoding::UTF8;
+    Utf8Mode utf8Mode = Utf8Mode::LENIENT;
+
+    // 0 picks one per batch, the last one used is kept in chunk
+    uint64_t fixedChunk = 0;
+    uint64_t chunk = 0;
+
+    std::vector<uint64_t> bits;
+    WorkStealingPool pool;
+
+    template <typename Get>
+    const std::vector<uint64_t>& evalAll(uint64_t count, Get candidate);
+
+public:
+    // 0 threads uses every core, chunk sizes are rounded up to BATCH_ALIGN
+    BatchMatcher(const std::string& pattern, bool lazy = true, Encoding encoding = Encoding::UTF8,
+                 uint32_t flags = 0, unsigned numThreads = 0, uint64_t chunkSize = 0);
+
+    unsigned numThreads() const {return pool.size();}
+    uint64_t chunkSize() const {return chunk;}
+
+    void setUtf8Mode(Utf8Mode mode) {utf8Mode = mode;}
+
+    // bit i is set if candidate i matches. The bitmap is reused by the next eval
+    const std::vector<uint64_t>& eval(std::span<const std::string_view> candidates);
+
+    // candidate i is data[offsets[i], offsets[i + 1])
+    const std::vector<uint64_t>& eval(std::string_view data, std::span<const uint64_t> offsets);
+
+    static bool matched(const std::vector<uint64_t>& bits, uint64_t i) {
+        return bits[i >> 6] >> (i & 63) & 1;
+    }
+};
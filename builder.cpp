@@ -0,0 +1,129 @@
+#include "builder.hpp"
+
+LazyBuilder::LazyBuilder(DFA& dfa, uint64_t budget, int maxDepth)
+    : dfa(dfa), budget(budget), maxDepth(maxDepth) {
+    if (!dfa.lazy) {
+        throw std::invalid_argument("Only lazy DFAs are built in the background");
+    }
+    if (dfa.share) {
+        throw std::invalid_argument("The DFA already has a builder");
+    }
+
+    if (dfa.start) push({rootWeight, 0, dfa.start});
+
+    share.listening = true;
+    dfa.share = &share;
+    thread = std::thread(&LazyBuilder::loop, this);
+}
+
+LazyBuilder::~LazyBuilder() {
+    cancel();
+}
+
+void LazyBuilder::cancel() {
+    if (!thread.joinable()) return;
+
+    {
+        std::lock_guard lock(share.mutex);
+        cancelled = true;
+        share.listening = false;
+    }
+    share.wake.notify_one();
+
+    thread.join();
+    dfa.share = nullptr;
+}
+
+BuildStats LazyBuilder::getStats() {
+    std::lock_guard lock(share.mutex);
+    return stats;
+}
+
+void LazyBuilder::push(const Item& item) {
+    auto [it, fresh] = queued.try_emplace(item.state, item.weight);
+    if (!fresh) {
+        if (it->second >= item.weight) return;
+        it->second = item.weight;
+    }
+
+    frontier.push(item);
+}
+
+void LazyBuilder::expand(const Item& item) {
+    DfaState* state = item.state;
+
+    // a heavier copy was queued since
+    if (queued[state] > item.weight) return;
+
+    if (!state->processed) {
+        uint64_t before = dfa.numStates();
+        dfa.fill(state);
+
+        // new targets hold sets about the size of this one, once as a key
+        // and once in the state
+        uint64_t perState = sizeof(DfaState) + 2 * state->nfaStates.size() * sizeof(State*);
+        stats.bytes += state->neighbors.capacity() * sizeof(Interval<DfaState*>);
+        stats.bytes += (dfa.numStates() - before) * perState;
+        stats.filled++;
+    }
+
+    // the next steps wait until everything nearer is built
+    if (item.depth >= maxDepth) {
+        deferred.push_back(item);
+        return;
+    }
+
+    // inputs are mostly ascii, the chars above count as one
+    auto width = [](uint64_t l, uint64_t r) -> uint64_t {
+        uint64_t ascii = l < 0x80 ? std::min<uint64_t>(r, 0x7f) - l + 1 : 0;
+        return ascii + (r >= 0x80);
+    };
+
+    uint64_t total = 0;
+    for (auto& [l, r, next] : state->neighbors) total += width(l, r);
+
+    for (auto& [l, r, next] : state->neighbors) {
+        double part = static_cast<double>(width(l, r)) / total;
+        push({item.weight * part, item.depth + 1, next});
+    }
+}
+
+void LazyBuilder::loop() {
+    std::unique_lock lock(share.mutex);
+
+    while (true) {
+        if (frontier.empty()) {
+            for (Item& item : deferred) frontier.push({item.weight, 0, item.state});
+            deferred.clear();
+        }
+
+        share.wake.wait(lock, [this]() {
+            return cancelled || !share.misses.empty() || !frontier.empty();
+        });
+        if (cancelled) return;
+
+        // the latest miss is where the matcher is now
+        for (DfaState* miss : share.misses) {
+            stats.misses++;
+            push({++rootWeight, 0, miss});
+        }
+        share.misses.clear();
+
+        if (stats.bytes >= budget) {
+            stats.overBudget = true;
+            share.listening = false;
+            return;
+        }
+
+        if (!frontier.empty()) {
+            Item item = frontier.top();
+            frontier.pop();
+            expand(item);
+        }
+
+        // a matching thread waiting to fill a state goes first
+        lock.unlock();
+        while (share.waiting.load()) std::this_thread::yield();
+        lock.lock();
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "dfa.hpp"
+
+#include <queue>
+#include <thread>
+
+// constants
+
+// states this many steps past the start state or a state the matching
+// thread had to fill itself are left until all nearer ones are built
+constexpr int BUILD_DEPTH = 6;
+
+// data structures
+
+struct BuildStats {
+    uint64_t filled = 0;
+
+    // about what the filled states and the targets they created took
+    uint64_t bytes = 0;
+
+    // states the matching thread filled itself while the builder listened
+    uint64_t misses = 0;
+    bool overBudget = false;
+};
+
+// fills the states of a lazy DFA on a background thread, so the matching
+// thread mostly finds them filled. States are built best first from the
+// start state, each weighted by its parent's weight times the share of
+// ascii chars leading to it. A state the matching thread had to fill itself
+// shows where the input really goes, so it becomes a new root weighted above
+// every earlier one. States BUILD_DEPTH steps out wait until nothing nearer
+// is left. Building stops after about budget bytes. The DFA has to
+// outlive the builder, which is cancelled by the thread matching with it
+class LazyBuilder {
+private:
+    struct Item {
+        double weight;
+        int depth;
+        DfaState* state;
+
+        // heaviest first, then the fewest steps out
+        bool operator<(const Item& other) const {
+            return weight != other.weight ? weight < other.weight : depth > other.depth;
+        }
+    };
+
+    DFA& dfa;
+    FillShare share;
+    uint64_t budget;
+    int maxDepth;
+
+    // under share.mutex
+    std::priority_queue<Item> frontier;
+    std::vector<Item> deferred;
+    HashMap<DfaState*, double> queued;
+    double rootWeight = 1;
+    BuildStats stats;
+    bool cancelled = false;
+
+    std::thread thread;
+
+    void push(const Item& item);
+    void expand(const Item& item);
+    void loop();
+
+public:
+    LazyBuilder(DFA& dfa, uint64_t budget, int maxDepth = BUILD_DEPTH);
+    ~LazyBuilder();
+
+    LazyBuilder(const LazyBuilder&) = delete;
+    LazyBuilder& operator=(const LazyBuilder&) = delete;
+
+    // stops building and returns once the thread is gone, the DFA is left
+    // to the matching thread alone
+    void cancel();
+
+    BuildStats getStats();
+};
@@ -0,0 +1,118 @@
+#include "cache.hpp"
+
+Postfix compilePostfix(std::string_view pattern, Encoding encoding, uint32_t flags,
+                       uint64_t maxNfaStates) {
+    Postfix postfix = encoding == Encoding::BYTES ? regexToPostfix(ByteView(pattern), flags)
+                                                  : regexToPostfix(UTF8View(pattern), flags);
+    return simplifyPostfix(std::move(postfix), maxNfaStates);
+}
+
+void requireEncoding(Encoding encoding, Encoding expected) {
+    if (encoding != expected) {
+        throw std::invalid_argument("Candidate does not match the regex encoding");
+    }
+}
+
+std::shared_ptr<Program> compileProgram(const ProgramKey& key, uint64_t maxNfaStates,
+                                        unsigned buildThreads) {
+    auto program = std::make_shared<Program>();
+    program->nfa = NFA(compilePostfix(key.pattern, key.encoding, key.flags, maxNfaStates));
+
+    if (key.eager) program->dfa = DFA(program->nfa, false, buildThreads);
+    return program;
+}
+
+std::shared_ptr<Program> RegexCache::get(const ProgramKey& key, uint64_t maxNfaStates) {
+    Shard& shard = shardOf(key);
+
+    {
+        std::lock_guard lock(shard.mutex);
+        auto it = shard.index.find(key);
+
+        if (it != shard.index.end()) {
+            shard.hits++;
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+
+            // compiled by a regex with a higher limit
+            checkNfaSize(it->second->program->nfa.numStates(), maxNfaStates);
+            return it->second->program;
+        }
+
+        shard.misses++;
+    }
+
+    return insert(shard, key, compileProgram(key, maxNfaStates, buildThreads.load()));
+}
+
+std::shared_ptr<Program> RegexCache::insert(Shard& shard, const ProgramKey& key,
+                                            std::shared_ptr<Program> program) {
+    uint64_t bytes = program->memoryUsage() + sizeof(Entry) + key.pattern.size();
+    uint64_t limit = shardBudget();
+
+    std::lock_guard lock(shard.mutex);
+
+    // another thread compiled the same pattern meanwhile, keep the first
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return it->second->program;
+    }
+
+    if (bytes > limit) return program;
+
+    shard.lru.push_front({key, program, bytes});
+    shard.index.emplace(key, shard.lru.begin());
+    shard.bytes += bytes;
+
+    evict(shard, limit);
+    return program;
+}
+
+void RegexCache::evict(Shard& shard, uint64_t limit) {
+    while (shard.bytes > limit) {
+        Entry& last = shard.lru.back();
+        shard.bytes -= last.bytes;
+        shard.index.erase(last.key);
+        shard.lru.pop_back();
+        shard.evictions++;
+    }
+}
+
+void RegexCache::setBudget(uint64_t bytes) {
+    budget.store(bytes, std::memory_order_relaxed);
+    uint64_t limit = shardBudget();
+
+    for (Shard& shard : shards) {
+        std::lock_guard lock(shard.mutex);
+        evict(shard, limit);
+    }
+}
+
+void RegexCache::clear() {
+    for (Shard& shard : shards) {
+        std::lock_guard lock(shard.mutex);
+        shard.index.clear();
+        shard.lru.clear();
+        shard.bytes = 0;
+    }
+}
+
+CacheStats RegexCache::stats() {
+    CacheStats res;
+
+    for (Shard& shard : shards) {
+        std::lock_guard lock(shard.mutex);
+        res.hits += shard.hits;
+        res.misses += shard.misses;
+        res.evictions += shard.evictions;
+        res.entries += shard.lru.size();
+        res.bytes += shard.bytes;
+    }
+
+    return res;
+}
+
+RegexCache& RegexCache::global() {
+    static RegexCache cache;
+    return cache;
+}
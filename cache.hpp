@@ -0,0 +1,135 @@
+#pragma once
+
+#include "dfa.hpp"
+#include "ast.hpp"
+
+#include <array>
+#include <atomic>
+#include <list>
+#include <mutex>
+
+// constants
+
+constexpr uint64_t CACHE_SHARDS = 16;
+constexpr uint64_t DEFAULT_CACHE_BYTES = 64ULL << 20;
+
+// data structures
+
+// what a pattern compiles to. An eager DFA has every state filled, so
+// matching only reads it and one program can serve any number of Regex
+// objects and threads. Lazy DFAs fill states while matching, they are built
+// per Regex on top of the shared NFA
+struct Program {
+    NFA nfa;
+    DFA dfa;
+
+    uint64_t memoryUsage() const {
+        return nfa.memoryUsage() + dfa.memoryUsage();
+    }
+};
+
+// lazy and NFA-only regexes share the same program, only eager ones carry a DFA
+struct ProgramKey {
+    std::string pattern;
+    Encoding encoding = Encoding::UTF8;
+    uint32_t flags = 0;
+    bool eager = false;
+
+    bool operator==(const ProgramKey&) const = default;
+};
+
+template <>
+struct ankerl::unordered_dense::hash<ProgramKey> {
+    using is_avalanching = void;
+
+    std::size_t operator()(const ProgramKey& key) const noexcept {
+        uint64_t mode = static_cast<uint64_t>(key.flags) << 16 |
+                        static_cast<uint64_t>(key.encoding) << 8 | key.eager;
+
+        return ankerl::unordered_dense::detail::wyhash::mix(
+            ankerl::unordered_dense::hash<std::string>{}(key.pattern),
+            mode + 0x9E3779B97F4A7C15ULL
+        );
+    }
+};
+
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t entries = 0;
+    uint64_t bytes = 0;
+};
+
+// LRU cache of compiled programs under a byte budget. Keys are spread over
+// shards with a lock each, so threads compiling different patterns rarely
+// wait on each other, and patterns are compiled outside of the lock
+class RegexCache {
+private:
+    struct Entry {
+        ProgramKey key;
+        std::shared_ptr<Program> program;
+        uint64_t bytes;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> lru;   // most recently used first
+        HashMap<ProgramKey, std::list<Entry>::iterator> index;
+        uint64_t bytes = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+    };
+
+    std::array<Shard, CACHE_SHARDS> shards;
+    std::atomic<uint64_t> budget;
+    std::atomic<unsigned> buildThreads = 1;
+
+    Shard& shardOf(const ProgramKey& key) {
+        return shards[(ankerl::unordered_dense::hash<ProgramKey>{}(key) >> 32) % CACHE_SHARDS];
+    }
+
+    uint64_t shardBudget() const {
+        return budget.load(std::memory_order_relaxed) / CACHE_SHARDS;
+    }
+
+    std::shared_ptr<Program> insert(Shard& shard, const ProgramKey& key,
+                                    std::shared_ptr<Program> program);
+    void evict(Shard& shard, uint64_t limit);
+
+public:
+    RegexCache(uint64_t budget = DEFAULT_CACHE_BYTES) : budget(budget) {}
+
+    // the program for key, compiled on a miss. Throws like compiling would
+    // if the program needs more than maxNfaStates states
+    std::shared_ptr<Program> get(const ProgramKey& key,
+                                 uint64_t maxNfaStates = DEFAULT_MAX_NFA_STATES);
+
+    // a budget of 0 turns caching off, programs in use are never freed early
+    void setBudget(uint64_t bytes);
+
+    // threads building each eager DFA compiled from now on, 0 uses every
+    // core. The DFA is the same either way, so keys ignore it
+    void setBuildThreads(unsigned numThreads) {buildThreads = numThreads;}
+    void clear();
+
+    CacheStats stats();
+
+    // shared by every Regex in the process
+    static RegexCache& global();
+};
+
+// function declarations
+
+// the simplified postfix of a pattern. Byte patterns are parsed bytewise,
+// all others as utf8 text
+Postfix compilePostfix(std::string_view pattern, Encoding encoding, uint32_t flags = 0,
+                       uint64_t maxNfaStates = DEFAULT_MAX_NFA_STATES);
+
+// matchers take candidates in the encoding they were compiled for
+void requireEncoding(Encoding encoding, Encoding expected);
+
+std::shared_ptr<Program> compileProgram(const ProgramKey& key,
+                                        uint64_t maxNfaStates = DEFAULT_MAX_NFA_STATES,
+                                        unsigned buildThreads = 1);
@@ -0,0 +1,116 @@
+#include "column.hpp"
+
+ColumnMatcher::ColumnMatcher(const std::string& pattern, bool lazy, Encoding encoding,
+                             uint32_t flags)
+    : lazy(lazy), encoding(encoding) {
+    if (encoding != Encoding::BYTES && encoding != Encoding::UTF8) {
+        throw std::invalid_argument("Columns hold byte or utf8 rows");
+    }
+
+    program = RegexCache::global().get({pattern, encoding, flags, !lazy});
+    if (lazy) lazyDfa = DFA(program->nfa, true);
+}
+
+template <bool Select, bool Utf8, typename Offset>
+void ColumnMatcher::scan(std::string_view data, std::span<const Offset> offsets) {
+    uint64_t rows = offsets.empty() ? 0 : offsets.size() - 1;
+    if (rows == 0) return;
+
+    if (offsets.front() < 0 || static_cast<uint64_t>(offsets.back()) > data.size()) {
+        throw std::invalid_argument("Offsets run outside the data buffer");
+    }
+
+    DFA& dfa = getDfa();
+    DfaState* start = dfa.start;
+    Utf8Mode mode = utf8Mode;
+
+    auto emit = [this](uint64_t row) {
+        if constexpr (Select) selection.push_back(row);
+        else bits[row >> 6] |= 1ULL << (row & 63);
+    };
+
+    // each row ends where the next begins, a row that falls off the DFA
+    // is left at once
+    const char* ptr = data.data() + offsets[0];
+    for (uint64_t row = 0; row < rows; row++) {
+        if (offsets[row + 1] < offsets[row]) {
+            throw std::invalid_argument("Offsets decrease at row " + std::to_string(row));
+        }
+        const char* end = data.data() + offsets[row + 1];
+
+        if (start == nullptr) {
+            if (ptr == end) emit(row);
+            ptr = end;
+            continue;
+        }
+
+        if constexpr (Utf8) {
+            if (mode == Utf8Mode::REJECT && !validateUtf8(ptr, end)) {
+                ptr = end;
+                continue;
+            }
+        }
+
+        DfaState* curr = start;
+        while (ptr != end) {
+            if (!curr->processed) dfa.fillNeighbors(curr);
+
+            // self-looping state, skip straight to the next escaping char
+            if (curr->numEscapes >= 0) {
+                ptr = dfa.skipSelfLoop(curr, ptr, end);
+                if (ptr == end) break;
+            }
+
+            char32_t c = static_cast<uint8_t>(*ptr);
+            if (Utf8 && c >= 0x80) {
+                int len;
+                c = decodeUtf8(ptr, end, len, mode);
+                ptr += len;
+            }
+            else ptr++;
+
+            curr = DFA::findNeighbor(curr, c);
+            if (curr == nullptr) break;
+        }
+        ptr = end;
+
+        if (curr == nullptr) continue;
+        if (!curr->processed) dfa.fillNeighbors(curr);
+        if (curr->isMatch) emit(row);
+    }
+}
+
+template <bool Select, typename Offset>
+void ColumnMatcher::dispatch(std::string_view data, std::span<const Offset> offsets) {
+    uint64_t rows = offsets.empty() ? 0 : offsets.size() - 1;
+
+    if constexpr (Select) selection.clear();
+    else bits.assign((rows + 63) / 64, 0);
+
+    if (encoding == Encoding::BYTES) scan<Select, false>(data, offsets);
+    else scan<Select, true>(data, offsets);
+}
+
+const std::vector<uint64_t>& ColumnMatcher::filter(std::string_view data,
+                                                   std::span<const int32_t> offsets) {
+    dispatch<false>(data, offsets);
+    return bits;
+}
+
+const std::vector<uint64_t>& ColumnMatcher::filter(std::string_view data,
+                                                   std::span<const int64_t> offsets) {
+    dispatch<false>(data, offsets);
+    return bits;
+}
+
+const std::vector<uint64_t>& ColumnMatcher::select(std::string_view data,
+                                                   std::span<const int32_t> offsets) {
+    dispatch<true>(data, offsets);
+    return selection;
+}
+
+const std::vector<uint64_t>& ColumnMatcher::select(std::string_view data,
+                                                   std::span<const int64_t> offsets) {
+    dispatch<true>(data, offsets);
+    return selection;
+}
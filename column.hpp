@@ -0,0 +1,47 @@
+#pragma once
+
+#include "cache.hpp"
+
+#include <span>
+
+// data structures
+
+// one regex matched against every row of an arrow style string column, one
+// data buffer where row i is data[offsets[i], offsets[i + 1]). The rows are
+// walked in one loop over the buffer, restarting the DFA at each offset, so
+// no row is copied or wrapped in a view. Offsets may start past 0, as in a
+// sliced column
+class ColumnMatcher {
+private:
+    std::shared_ptr<Program> program;
+    DFA lazyDfa;
+    bool lazy = false;
+    Encoding encoding = Encoding::UTF8;
+    Utf8Mode utf8Mode = Utf8Mode::LENIENT;
+
+    std::vector<uint64_t> bits;
+    std::vector<uint64_t> selection;
+
+    DFA& getDfa() {return lazy ? lazyDfa : program->dfa;}
+
+    template <bool Select, bool Utf8, typename Offset>
+    void scan(std::string_view data, std::span<const Offset> offsets);
+
+    template <bool Select, typename Offset>
+    void dispatch(std::string_view data, std::span<const Offset> offsets);
+
+public:
+    ColumnMatcher(const std::string& pattern, bool lazy = false, Encoding encoding = Encoding::UTF8,
+                  uint32_t flags = 0);
+
+    void setUtf8Mode(Utf8Mode mode) {utf8Mode = mode;}
+
+    // bit i is set if row i matches, low bits first as in an arrow validity
+    // bitmap. The bitmap is reused by the next call
+    const std::vector<uint64_t>& filter(std::string_view data, std::span<const int32_t> offsets);
+    const std::vector<uint64_t>& filter(std::string_view data, std::span<const int64_t> offsets);
+
+    // the indices of the matching rows, ascending. Reused by the next call
+    const std::vector<uint64_t>& select(std::string_view data, std::span<const int32_t> offsets);
+    const std::vector<uint64_t>& select(std::string_view data, std::span<const int64_t> offsets);
+};
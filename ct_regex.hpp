@@ -0,0 +1,740 @@
+#pragma once
+
+#include "nfa.hpp"
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// constants
+
+// compile time work is bounded, a runaway pattern fails the build instead
+// of stalling it
+constexpr uint64_t CT_MAX_NFA_STATES = 10000;
+constexpr uint64_t CT_MAX_DFA_STATES = 4096;
+
+// data structures
+
+// string literal usable as a template argument
+template <size_t N>
+struct FixedString {
+    char data[N] = {};
+
+    constexpr FixedString(const char (&str)[N]) {
+        std::copy_n(str, N, data);
+    }
+
+    constexpr std::string_view view() const {
+        return {data, N - 1};
+    }
+};
+
+struct ByteSet {
+    uint64_t bits[4] = {};
+
+    constexpr void insert(uint8_t c) {
+        bits[c >> 6] |= 1ULL << (c & 63);
+    }
+
+    constexpr void insert(uint8_t l, uint8_t r) {
+        for (unsigned c = l; c <= r; c++) insert(c);
+    }
+
+    constexpr bool contains(uint8_t c) const {
+        return bits[c >> 6] >> (c & 63) & 1;
+    }
+
+    constexpr void merge(const ByteSet& other) {
+        for (int i = 0; i < 4; i++) bits[i] |= other.bits[i];
+    }
+
+    constexpr void invert() {
+        for (uint64_t& word : bits) word = ~word;
+    }
+};
+
+enum class CtNode : uint8_t {
+    CHAR,
+    SPLIT,
+    EPSILON,
+    MATCH
+};
+
+struct CtState {
+    CtNode type;
+    ByteSet chars;
+    int out = -1;
+    int out1 = -1;
+};
+
+// exit is an EPSILON state whose out is filled in by whatever follows
+struct CtFragment {
+    int entry;
+    int exit;
+};
+
+// a constexpr twin of the runtime parser, with the semantics of
+// Encoding::BYTES: every byte is a char and class escapes are ascii. Counted
+// repetitions are unrolled by parsing their operand once per copy
+class CtCompiler {
+private:
+    std::string_view pattern;
+    uint64_t pos = 0;
+    uint64_t end = 0;
+    bool icase = false;
+
+    constexpr int makeState(CtNode type, int out = -1, int out1 = -1) {
+        if (states.size() >= CT_MAX_NFA_STATES) {
+            throw std::runtime_error("Regex is too large to build at compile time");
+        }
+        states.push_back({type, {}, out, out1});
+        return states.size() - 1;
+    }
+
+    constexpr CtFragment makeChars(ByteSet chars) {
+        // case-insensitive byte regexes only fold a-z
+        if (icase) {
+            for (uint8_t c = 'a'; c <= 'z'; c++) {
+                if (chars.contains(c) || chars.contains(c - 32)) {
+                    chars.insert(c);
+                    chars.insert(c - 32);
+                }
+            }
+        }
+
+        int exit = makeState(CtNode::EPSILON);
+        int entry = makeState(CtNode::CHAR, exit);
+        states[entry].chars = chars;
+        return {entry, exit};
+    }
+
+    constexpr CtFragment makeEmpty() {
+        int state = makeState(CtNode::EPSILON);
+        return {state, state};
+    }
+
+    constexpr CtFragment concatenate(CtFragment left, CtFragment right) {
+        states[left.exit].out = right.entry;
+        return {left.entry, right.exit};
+    }
+
+    constexpr CtFragment alternate(CtFragment left, CtFragment right) {
+        int exit = makeState(CtNode::EPSILON);
+        states[left.exit].out = exit;
+        states[right.exit].out = exit;
+        return {makeState(CtNode::SPLIT, left.entry, right.entry), exit};
+    }
+
+    constexpr CtFragment star(CtFragment body) {
+        int exit = makeState(CtNode::EPSILON);
+        int loop = makeState(CtNode::SPLIT, body.entry, exit);
+        states[body.exit].out = loop;
+        return {loop, exit};
+    }
+
+    constexpr CtFragment plus(CtFragment body) {
+        int exit = makeState(CtNode::EPSILON);
+        states[body.exit].out = makeState(CtNode::SPLIT, body.entry, exit);
+        return {body.entry, exit};
+    }
+
+    constexpr CtFragment question(CtFragment body) {
+        int exit = makeState(CtNode::EPSILON);
+        states[body.exit].out = exit;
+        return {makeState(CtNode::SPLIT, body.entry, exit), exit};
+    }
+
+    static constexpr bool isClassEscape(char c) {
+        return std::string_view("dDwWsS").find(c) != std::string_view::npos;
+    }
+
+    static constexpr ByteSet classEscape(char c) {
+        ByteSet res;
+        char lower = c | 0x20;
+
+        if (lower == 'd') res.insert('0', '9');
+        else if (lower == 'w') {
+            res.insert('0', '9');
+            res.insert('A', 'Z');
+            res.insert('_');
+            res.insert('a', 'z');
+        }
+        else {
+            res.insert('\t', '\r');
+            res.insert(' ');
+        }
+
+        if (c != lower) res.invert();
+        return res;
+    }
+
+    constexpr char_t parseCount(std::string_view digits) const {
+        if (digits.empty() || digits.size() > 9) {
+            throw std::runtime_error("Malformed repetition");
+        }
+
+        uint64_t count = 0;
+        for (char d : digits) {
+            if (d < '0' || d > '9') throw std::runtime_error("Malformed repetition");
+            count = count * 10 + (d - '0');
+        }
+
+        if (count > REPEAT_MAX) {
+            throw std::runtime_error("Repetition count too large");
+        }
+        return count;
+    }
+
+    // reads the {n}, {n,} or {n,m} at pos
+    constexpr ClassInterval parseBounds() {
+        uint64_t close = pattern.find('}', pos);
+        if (close == std::string_view::npos || close >= end) {
+            throw std::runtime_error("Unterminated repetition");
+        }
+
+        std::string_view body = pattern.substr(pos + 1, close - pos - 1);
+        pos = close + 1;
+
+        uint64_t comma = body.find(',');
+        if (comma == std::string_view::npos) {
+            char_t count = parseCount(body);
+            return {count, count};
+        }
+
+        std::string_view upper = body.substr(comma + 1);
+        char_t min = parseCount(body.substr(0, comma));
+        char_t max = upper.empty() ? REPEAT_INF : parseCount(upper);
+
+        if (min > max) {
+            throw std::runtime_error("Repetition bounds out of order");
+        }
+        return {min, max};
+    }
+
+    constexpr CtFragment parseClass() {
+        ByteSet res;
+        std::vector<ClassInterval> ranges;
+        bool empty = true;
+        bool escaped = false;
+        bool hyphen = false;
+        bool afterClassEscape = false;
+
+        for (pos++;; pos++) {
+            if (pos >= end) {
+                throw std::runtime_error("Unterminated character class");
+            }
+
+            uint8_t c = pattern[pos];
+
+            if (!escaped && c == '\\') {
+                escaped = true;
+                continue;
+            }
+            if (!escaped && c == '[') {
+                throw std::runtime_error("Unexpected '[' in character class");
+            }
+            if (!escaped && c == ']') break;
+
+            if (escaped && (c == 'p' || c == 'P')) {
+                throw std::runtime_error("Unicode properties are not supported at compile time");
+            }
+            if (escaped && isClassEscape(c)) {
+                if (hyphen) {
+                    throw std::runtime_error("Class escape in a character class range");
+                }
+                escaped = false;
+                res.merge(classEscape(c));
+                empty = false;
+                afterClassEscape = true;
+                continue;
+            }
+
+            // a hyphen right after a class escape is a plain '-'
+            bool literalHyphen = afterClassEscape;
+            afterClassEscape = false;
+
+            if (escaped || hyphen || c != '-' || empty || literalHyphen) {
+                escaped = false;
+                empty = false;
+                ranges.push_back({c, c});
+
+                if (hyphen) {
+                    hyphen = false;
+                    auto [l1, r1] = ranges.back();
+                    ranges.pop_back();
+                    auto [l2, r2] = ranges.back();
+                    ranges.pop_back();
+                    ranges.push_back({std::min(l1, l2), std::max(r1, r2)});
+                }
+            }
+            else {
+                if (hyphen) {
+                    throw std::runtime_error("Double-hyphen in character class");
+                }
+                hyphen = true;
+            }
+        }
+
+        if (hyphen) {
+            throw std::runtime_error("Unmatched hyphen in character class");
+        }
+
+        pos++;
+        for (auto [l, r] : ranges) res.insert(l, r);
+        return makeChars(res);
+    }
+
+    constexpr CtFragment parseAtom() {
+        uint8_t c = pattern[pos++];
+
+        if (c == '(') {
+            CtFragment res = parseUnion(true);
+            if (pos >= end) throw std::runtime_error("No matching )");
+            pos++;
+            return res;
+        }
+        if (c == '[') {
+            pos--;
+            return parseClass();
+        }
+        if (c == ']') {
+            throw std::runtime_error("Unexpected ']' outside of character class");
+        }
+        if (c == '*' || c == '+' || c == '?' || c == '{') {
+            throw std::runtime_error("Nothing to repeat");
+        }
+
+        ByteSet chars;
+
+        if (c == '\\') {
+            if (pos >= end) throw std::runtime_error("Trailing backslash");
+            c = pattern[pos++];
+
+            if (c == 'p' || c == 'P') {
+                throw std::runtime_error("Unicode properties are not supported at compile time");
+            }
+            if (isClassEscape(c)) return makeChars(classEscape(c));
+            chars.insert(c);
+        }
+        else if (c == '.') chars.invert();
+        else chars.insert(c);
+
+        return makeChars(chars);
+    }
+
+    // x^n followed by m - n nested optionals (x(x(x)?)?)?, or by x* if unbounded
+    constexpr CtFragment repeat(CtFragment body, uint64_t begin, uint64_t quantifier,
+                                ClassInterval bounds) {
+        bool first = true;
+
+        auto copy = [&]() {
+            if (first) {
+                first = false;
+                return body;
+            }
+
+            uint64_t saved = pos;
+            pos = begin;
+            CtFragment res = parsePiece(quantifier);
+            pos = saved;
+            return res;
+        };
+
+        auto [min, max] = bounds;
+        CtFragment res = makeEmpty();
+
+        if (max == REPEAT_INF) {
+            for (char_t i = 1; i < min; i++) res = concatenate(res, copy());
+            return concatenate(res, min ? plus(copy()) : star(copy()));
+        }
+
+        for (char_t i = 0; i < min; i++) res = concatenate(res, copy());
+        if (min == max) return res;
+
+        CtFragment tail = question(copy());
+        for (char_t i = min + 1; i < max; i++) {
+            tail = question(concatenate(copy(), tail));
+        }
+        return concatenate(res, tail);
+    }
+
+    // an atom and the quantifiers after it that start before limit
+    constexpr CtFragment parsePiece(uint64_t limit) {
+        uint64_t begin = pos;
+        CtFragment res = parseAtom();
+
+        while (pos < limit) {
+            char c = pattern[pos];
+
+            if (c == '*') res = star(res);
+            else if (c == '+') res = plus(res);
+            else if (c == '?') res = question(res);
+            else if (c == '{') {
+                uint64_t quantifier = pos;
+                ClassInterval bounds = parseBounds();
+                res = repeat(res, begin, quantifier, bounds);
+                continue;
+            }
+            else break;
+
+            pos++;
+        }
+
+        return res;
+    }
+
+    constexpr CtFragment parseConcat() {
+        CtFragment res = makeEmpty();
+
+        while (pos < end && pattern[pos] != '|' && pattern[pos] != ')') {
+            res = concatenate(res, parsePiece(end));
+        }
+
+        return res;
+    }
+
+    // an empty alternative is only allowed as the whole pattern, like in
+    // the runtime parser
+    constexpr CtFragment parseUnion(bool group) {
+        uint64_t begin = pos;
+        CtFragment res = parseConcat();
+        bool emptyAlternative = pos == begin;
+        bool alternated = false;
+
+        while (pos < end && pattern[pos] == '|') {
+            begin = ++pos;
+            res = alternate(res, parseConcat());
+            emptyAlternative |= pos == begin;
+            alternated = true;
+        }
+
+        if (emptyAlternative && (group || alternated)) {
+            throw std::runtime_error("Empty alternative");
+        }
+        return res;
+    }
+
+    constexpr bool escapedAtEnd() const {
+        uint64_t numSlashes = 0;
+        for (int64_t idx = pattern.size() - 2; idx >= 0 && pattern[idx] == '\\'; idx--) {
+            numSlashes++;
+        }
+        return numSlashes & 1;
+    }
+
+public:
+    std::vector<CtState> states;
+    int start = -1;
+
+    constexpr CtCompiler(std::string_view regex, uint32_t flags) : pattern(regex) {
+        // inline flags, only at the very start
+        if (pattern.starts_with("(?i)")) {
+            flags |= FLAG_ICASE;
+            pattern.remove_prefix(4);
+        }
+        icase = flags & (FLAG_ICASE | FLAG_ICASE_ASCII);
+
+        // the empty regex only matches the empty string
+        if (pattern.empty()) {
+            start = makeState(CtNode::MATCH);
+            return;
+        }
+
+        bool leftAnchor = pattern[0] == '^';
+        bool rightAnchor = pattern.back() == '$' && !escapedAtEnd();
+        pos = leftAnchor;
+        end = pattern.size() - rightAnchor;
+
+        CtFragment res = parseUnion(false);
+        if (pos < end) throw std::runtime_error("No matching (");
+
+        ByteSet any;
+        any.invert();
+
+        if (!leftAnchor) res = concatenate(star(makeChars(any)), res);
+        if (!rightAnchor) res = concatenate(res, star(makeChars(any)));
+
+        int match = makeState(CtNode::MATCH);
+        states[res.exit].out = match;
+        start = res.entry;
+    }
+};
+
+// a DFA over byte classes. Live states come first, the states that can no
+// longer change the outcome are folded into DEAD (numLive) and SINK
+// (numLive + 1), so matching stops as soon as it reaches an id >= numLive
+struct CtDfa {
+    std::array<uint8_t, 256> classOf = {};
+    uint64_t numClasses = 0;
+    uint64_t numLive = 0;
+    uint64_t start = 0;
+    std::vector<uint64_t> next;     // numLive rows of numClasses
+    std::vector<uint8_t> accept;
+
+    constexpr uint64_t dead() const {return numLive;}
+    constexpr uint64_t sink() const {return numLive + 1;}
+
+    constexpr bool eval(std::string_view candidate) const {
+        uint64_t curr = start;
+        if (curr >= numLive) return curr == sink();
+
+        for (char c : candidate) {
+            curr = next[curr * numClasses + classOf[static_cast<uint8_t>(c)]];
+            if (curr >= numLive) return curr == sink();
+        }
+
+        return accept[curr];
+    }
+};
+
+// the tables of a CtDfa with their sizes known, as static data
+template <uint64_t NumLive, uint64_t NumClasses>
+struct CtProgram {
+    using StateId = std::conditional_t<NumLive + 2 <= 256, uint8_t, uint16_t>;
+
+    std::array<uint8_t, 256> classOf = {};
+    std::array<StateId, NumLive * NumClasses> next = {};
+    std::array<bool, NumLive> accept = {};
+    StateId start = 0;
+};
+
+// function declarations
+
+constexpr CtDfa ctCompile(std::string_view pattern, uint32_t flags = 0);
+
+// a regex compiled while the program is: the pattern is parsed and its DFA
+// built during constant evaluation, and eval is a loop over static tables.
+// Patterns follow the Encoding::BYTES rules, malformed ones fail the build
+template <FixedString Pattern, uint32_t Flags = 0>
+class CtRegex {
+private:
+    struct Shape {
+        uint64_t numLive;
+        uint64_t numClasses;
+    };
+
+    static constexpr Shape SHAPE = []() {
+        CtDfa dfa = ctCompile(Pattern.view(), Flags);
+        return Shape{dfa.numLive, dfa.numClasses};
+    }();
+
+    using Program = CtProgram<SHAPE.numLive, SHAPE.numClasses>;
+    using StateId = typename Program::StateId;
+
+    static constexpr StateId DEAD = SHAPE.numLive;
+    static constexpr StateId SINK = SHAPE.numLive + 1;
+
+    static constexpr Program PROGRAM = []() {
+        CtDfa dfa = ctCompile(Pattern.view(), Flags);
+        Program res;
+
+        res.classOf = dfa.classOf;
+        res.start = dfa.start;
+        for (uint64_t i = 0; i < dfa.next.size(); i++) res.next[i] = dfa.next[i];
+        for (uint64_t i = 0; i < dfa.numLive; i++) res.accept[i] = dfa.accept[i];
+
+        return res;
+    }();
+
+public:
+    static constexpr bool eval(std::string_view candidate) {
+        StateId curr = PROGRAM.start;
+        if (curr >= DEAD) return curr == SINK;
+
+        for (char c : candidate) {
+            curr = PROGRAM.next[curr * SHAPE.numClasses + PROGRAM.classOf[static_cast<uint8_t>(c)]];
+            if (curr >= DEAD) return curr == SINK;
+        }
+
+        return PROGRAM.accept[curr];
+    }
+
+    static constexpr std::string_view pattern() {
+        return Pattern.view();
+    }
+
+    // live DFA states, the dead and accepting sinks are not tables
+    static constexpr uint64_t numStates() {
+        return SHAPE.numLive;
+    }
+};
+
+// constexpr functions
+
+constexpr CtDfa ctCompile(std::string_view pattern, uint32_t flags) {
+    CtCompiler nfa(pattern, flags);
+    const std::vector<CtState>& states = nfa.states;
+    CtDfa res;
+
+    // bytes that no state tells apart share a class
+    uint64_t numClasses = 1;
+    std::vector<const ByteSet*> refined;
+
+    for (const CtState& state : states) {
+        if (state.type != CtNode::CHAR) continue;
+
+        // copies from counted repetition refine nothing new
+        auto same = [&state](const ByteSet* chars) {
+            return std::equal(chars->bits, chars->bits + 4, state.chars.bits);
+        };
+        if (std::any_of(refined.begin(), refined.end(), same)) continue;
+        refined.push_back(&state.chars);
+
+        std::array<int, 512> remap;
+        remap.fill(-1);
+        int count = 0;
+
+        for (int c = 0; c < 256; c++) {
+            int key = res.classOf[c] * 2 + state.chars.contains(c);
+            if (remap[key] < 0) remap[key] = count++;
+            res.classOf[c] = remap[key];
+        }
+        numClasses = count;
+    }
+
+    std::vector<uint8_t> representative(numClasses);
+    for (int c = 255; c >= 0; c--) representative[res.classOf[c]] = c;
+
+    // sorted CHAR and MATCH states reachable from set without reading a byte
+    std::vector<uint64_t> visited(states.size());
+    std::vector<int> stack;
+    uint64_t generation = 0;
+
+    auto closure = [&](std::vector<int>& set) {
+        generation++;
+        stack.assign(set.begin(), set.end());
+        set.clear();
+
+        while (!stack.empty()) {
+            int state = stack.back();
+            stack.pop_back();
+            if (visited[state] == generation) continue;
+            visited[state] = generation;
+
+            const CtState& curr = states[state];
+            if (curr.type == CtNode::CHAR || curr.type == CtNode::MATCH) set.push_back(state);
+            if (curr.type == CtNode::SPLIT) stack.push_back(curr.out1);
+            if (curr.type == CtNode::SPLIT || curr.type == CtNode::EPSILON) stack.push_back(curr.out);
+        }
+
+        std::sort(set.begin(), set.end());
+    };
+
+    // subset construction, sets are found through an open addressing table
+    std::vector<std::vector<int>> sets;
+    std::vector<uint64_t> hashes;
+    std::vector<int> buckets(64, -1);
+
+    auto hashOf = [](const std::vector<int>& set) {
+        uint64_t hash = 0xCBF29CE484222325ULL;
+        for (int state : set) hash = (hash ^ state) * 0x100000001B3ULL;
+        return hash;
+    };
+
+    auto insert = [&](uint64_t hash, int id) {
+        uint64_t mask = buckets.size() - 1;
+        uint64_t idx = hash & mask;
+        while (buckets[idx] >= 0) idx = (idx + 1) & mask;
+        buckets[idx] = id;
+    };
+
+    auto find = [&](std::vector<int>& set) {
+        uint64_t hash = hashOf(set);
+        uint64_t mask = buckets.size() - 1;
+
+        for (uint64_t idx = hash & mask; buckets[idx] >= 0; idx = (idx + 1) & mask) {
+            int id = buckets[idx];
+            if (hashes[id] == hash && sets[id] == set) return id;
+        }
+
+        if (sets.size() >= CT_MAX_DFA_STATES) {
+            throw std::runtime_error("DFA is too large to build at compile time");
+        }
+
+        int id = sets.size();
+        sets.push_back(set);
+        hashes.push_back(hash);
+
+        if (2 * sets.size() > buckets.size()) {
+            buckets.assign(2 * buckets.size(), -1);
+            for (uint64_t i = 0; i < sets.size(); i++) insert(hashes[i], i);
+        }
+        else insert(hash, id);
+
+        return id;
+    };
+
+    std::vector<int> curr = {nfa.start};
+    closure(curr);
+    find(curr);
+
+    std::vector<uint64_t> next;
+    std::vector<uint8_t> accept;
+
+    for (uint64_t i = 0; i < sets.size(); i++) {
+        bool isMatch = false;
+        for (int state : sets[i]) isMatch |= states[state].type == CtNode::MATCH;
+        accept.push_back(isMatch);
+
+        for (uint64_t k = 0; k < numClasses; k++) {
+            curr.clear();
+            for (int state : sets[i]) {
+                const CtState& s = states[state];
+                if (s.type == CtNode::CHAR && s.chars.contains(representative[k])) {
+                    curr.push_back(s.out);
+                }
+            }
+
+            closure(curr);
+            next.push_back(find(curr));
+        }
+    }
+
+    // states from which only rejection (dead) or only acceptance (sink)
+    // remains reachable
+    uint64_t numSets = sets.size();
+    std::vector<uint8_t> canAccept(accept), canReject(numSets);
+    for (uint64_t i = 0; i < numSets; i++) canReject[i] = !accept[i];
+
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        for (uint64_t i = 0; i < numSets; i++) {
+            for (uint64_t k = 0; k < numClasses; k++) {
+                uint64_t to = next[i * numClasses + k];
+                if (canAccept[to] && !canAccept[i]) canAccept[i] = changed = true;
+                if (canReject[to] && !canReject[i]) canReject[i] = changed = true;
+            }
+        }
+    }
+
+    std::vector<uint64_t> ids(numSets);
+    uint64_t numLive = 0;
+    for (uint64_t i = 0; i < numSets; i++) {
+        if (canAccept[i] && canReject[i]) ids[i] = numLive++;
+    }
+    for (uint64_t i = 0; i < numSets; i++) {
+        if (!canAccept[i]) ids[i] = numLive;
+        else if (!canReject[i]) ids[i] = numLive + 1;
+    }
+
+    res.numClasses = numClasses;
+    res.numLive = numLive;
+    res.start = ids[0];
+    res.next.resize(numLive * numClasses);
+    res.accept.resize(numLive);
+
+    for (uint64_t i = 0; i < numSets; i++) {
+        if (ids[i] >= numLive) continue;
+
+        res.accept[ids[i]] = accept[i];
+        for (uint64_t k = 0; k < numClasses; k++) {
+            res.next[ids[i] * numClasses + k] = ids[next[i * numClasses + k]];
+        }
+    }
+
+    return res;
+}
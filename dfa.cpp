@@ -1,15 +1,23 @@
 #include "dfa.hpp"
+#include "pool.hpp"
 
-void DFA::expandAndClean(std::vector<State*>& nfaStates) {
+#include <array>
+#include <bit>
 
-    nfaVisited.clear();
+void DFA::expandAndClean(std::vector<State*>& nfaStates, FillScratch& buf) {
+    auto& newStates = buf.newStates;
+    auto& splits = buf.splits;
+
+    buf.nfaVisited.clear();
     newStates.clear();
 
-    HashSet<State*>& lVisited = nfaVisited;
+    HashSet<State*>& lVisited = buf.nfaVisited;
     std::stack<State*, std::vector<State*>>& lSplits = splits;
+    State* lBase = base;
 
-    auto push = [&lVisited, &lSplits](State* state) {
-        if (lVisited.find(state) == lVisited.end()) {
+    // the base closure is implied, so it is not expanded again
+    auto push = [&lVisited, &lSplits, lBase](State* state) {
+        if (state != lBase && lVisited.find(state) == lVisited.end()) {
             lVisited.insert(state);
             lSplits.push(state);
         }
@@ -35,99 +43,659 @@ void DFA::expandAndClean(std::vector<State*>& nfaStates) {
         }
     }
 
+    if (base) {
+        std::erase_if(newStates, [this](State* state) {return baseSet.contains(state);});
+    }
+
     nfaStates = std::move(newStates);
     clean(nfaStates);
 }
 
+void DFA::accelerate(DfaState* state) {
+    int8_t numEscapes = 0;
+    uint64_t next = 0;
+
+    // chars in [l, r] leave the state, only ascii can be found bytewise
+    auto escape = [&](uint64_t l, uint64_t r) {
+        if (r >= 0x80 || r - l + 1 > static_cast<uint64_t>(MAX_ESCAPES - numEscapes)) {
+            return false;
+        }
+        for (uint64_t c = l; c <= r; c++) {
+            state->escapes[numEscapes++] = static_cast<char>(c);
+        }
+        return true;
+    };
+
+    // neighbors are sorted and disjoint, the gaps between self loops escape
+    for (auto& [l, r, neighbor] : state->neighbors) {
+        if (neighbor != state) continue;
+        if (l > next && !escape(next, l - 1)) return;
+        next = static_cast<uint64_t>(r) + 1;
+    }
+
+    if (next <= MAX_CHAR && !escape(next, MAX_CHAR)) return;
+    state->numEscapes = numEscapes;
+}
+
+void DFA::addRanges(State* nfaState, DfaState* owner, std::vector<Interval<State*>>& ranges) {
+    State* out = nfaState->out[0];
+
+    if (nfaState->type == NodeType::LITERAL) {
+        char_t c = nfaState->c;
+        ranges.push_back({c, c, out});
+    }
+    else if (nfaState->type == NodeType::WILDCARD) {
+        ranges.push_back({0, MAX_CHAR, out});
+    }
+    else if (nfaState->type == NodeType::RANGES) {
+        for (auto [l, r] : nfaState->ranges) {
+            ranges.push_back({l, r, out});
+        }
+    }
+    else if (nfaState->type == NodeType::MATCH) {
+        owner->isMatch = true;
+        uint32_t id = nfaState->c & ~MATCH_STICKY;
+        owner->matchIds.push_back(id);
+        if (nfaState->c & MATCH_STICKY) owner->stickyIds.push_back(id);
+    }
+}
+
+DfaState* DFA::stateFor(std::vector<State*>& nfaStates) {
+    auto [it, fresh] = nfaSetMap.try_emplace(nfaStates, nullptr);
+
+    if (fresh) {
+        it->second = createEmptyState();
+        it->second->nfaStates = std::move(nfaStates);
+        nfaStates.clear();
+
+        if (!lazy) stateStk.push(it->second);
+    }
+
+    return it->second;
+}
+
 void DFA::fillNeighbors(DfaState* newState) {
+    if (!share) return fill(newState);
+
+    share->waiting++;
+    std::unique_lock lock(share->mutex);
+    share->waiting--;
+
     if (newState->processed) return;
+    fill(newState);
 
-    stateRanges.clear();
-    
-    for (State* nfaState : newState->nfaStates) {
-        State* out = nfaState->out[0];
+    if (share->listening) {
+        share->misses.push_back(newState);
+        lock.unlock();
+        share->wake.notify_one();
+    }
+}
 
-        if (nfaState->type == NodeType::LITERAL) {
-            char_t c = nfaState->c;
-            stateRanges.push_back({c, c, out});
-        }
-        else if (nfaState->type == NodeType::WILDCARD) {
-            stateRanges.push_back({0, MAX_CHAR, out});
+void DFA::fill(DfaState* newState) {
+    fill(newState, scratch, [this](std::vector<State*>& nfaStates) {return stateFor(nfaStates);});
+}
+
+// calls emit(l, r, mask) for each run of chars [l, r] the same sources read,
+// bit i of mask standing for sources[i]. Every interval of a source is
+// sorted and disjoint, so each is only visited at its two ends
+template <typename Emit>
+static void sweepSources(std::vector<FillScratch::Source>& sources, Emit emit) {
+    uint64_t mask = 0;
+    uint64_t pos = 0;
+
+    while (true) {
+        uint64_t next = std::numeric_limits<uint64_t>::max();
+        for (auto& source : sources) {
+            if (source.pos == source.size()) continue;
+            const ClassInterval& range = source.at(source.pos);
+            next = std::min<uint64_t>(next, source.active ? range.r + 1ULL : range.l);
         }
-        else if (nfaState->type == NodeType::RANGES) {
-            for (auto [l, r] : nfaState->ranges) {
-                stateRanges.push_back({l, r, out});
+        if (next == std::numeric_limits<uint64_t>::max()) return;
+
+        if (mask && next > pos) emit(pos, next - 1, mask);
+        pos = next;
+
+        for (uint64_t i = 0; i < sources.size(); i++) {
+            auto& source = sources[i];
+            if (source.pos == source.size()) continue;
+            const ClassInterval& range = source.at(source.pos);
+
+            if (!source.active && range.l == next) {
+                source.active = true;
+                mask |= 1ULL << i;
+            }
+            else if (source.active && range.r + 1ULL == next) {
+                source.active = false;
+                mask &= ~(1ULL << i);
+                source.pos++;
             }
-        }
-        else if (nfaState->type == NodeType::MATCH) {
-            newState->isMatch = true;
         }
     }
+}
 
-    clean(stateRanges);
-    reconcile(stateRanges, stateSetRanges);
+template <typename Lookup>
+void DFA::fill(DfaState* newState, FillScratch& buf, Lookup stateOf) {
+    if (newState->processed) return;
 
-    for (auto& [l, r, nfaStates] : stateSetRanges) {
-        if (nfaStates.empty()) continue;
-        expandAndClean(nfaStates);
+    buf.targetMap.clear();
+    auto& neighbors = newState->neighbors;
 
-        DfaState* neighborState = nfaSetMap[nfaStates];
-        
-        if (!neighborState) {
-            neighborState = createEmptyState();
-            nfaSetMap[nfaStates] = neighborState;
-            neighborState->nfaStates = std::move(nfaStates);
+    // the ranges of a big class mostly lead to the same few sets
+    auto target = [&](std::vector<State*>& nfaStates) {
+        auto [known, fresh] = buf.targetMap.try_emplace(nfaStates, nullptr);
 
-            if (!lazy) stateStk.push(neighborState);
-            nfaStates.clear();
+        if (fresh) {
+            expandAndClean(nfaStates, buf);
+            known->second = stateOf(nfaStates);
         }
+        return known->second;
+    };
+
+    auto& stateRanges = buf.stateRanges;
+    stateRanges.clear();
+
+    if (newState->nfaStates.size() + baseStates.size() <= MAX_SWEEP_SOURCES) {
+        auto& sources = buf.sources;
+        sources.clear();
 
-        newState->neighbors.push_back({l, r, neighborState});
+        auto addSource = [&](State* nfaState) {
+            State* out = nfaState->out[0];
+
+            if (nfaState->type == NodeType::LITERAL) {
+                sources.push_back({{}, {nfaState->c, nfaState->c}, out});
+            }
+            else if (nfaState->type == NodeType::WILDCARD) {
+                sources.push_back({{}, {0, MAX_CHAR}, out});
+            }
+            else if (nfaState->type == NodeType::RANGES) {
+                if (!nfaState->ranges.empty()) sources.push_back({nfaState->ranges, {}, out});
+            }
+            else addRanges(nfaState, newState, stateRanges);
+        };
+
+        for (State* nfaState : newState->nfaStates) addSource(nfaState);
+        for (State* nfaState : baseStates) addSource(nfaState);
+
+        buf.maskTargets.clear();
+        std::vector<State*> set;
+
+        sweepSources(sources, [&](uint64_t l, uint64_t r, uint64_t mask) {
+            auto [known, fresh] = buf.maskTargets.try_emplace(mask, nullptr);
+
+            if (fresh) {
+                set.clear();
+                for (uint64_t bits = mask; bits; bits &= bits - 1) {
+                    set.push_back(sources[std::countr_zero(bits)].out);
+                }
+                clean(set);
+                known->second = target(set);
+            }
+
+            addNeighbor(neighbors, l, r, known->second);
+        });
+    }
+    else {
+        auto& stateSetRanges = buf.stateSetRanges;
+
+        for (State* nfaState : newState->nfaStates) addRanges(nfaState, newState, stateRanges);
+        for (State* nfaState : baseStates) addRanges(nfaState, newState, stateRanges);
+
+        clean(stateRanges);
+        reconcile(stateRanges, stateSetRanges, buf);
+
+        for (auto& [l, r, nfaStates] : stateSetRanges) {
+            if (nfaStates.empty()) continue;
+            clean(nfaStates);
+            addNeighbor(neighbors, l, r, target(nfaStates));
+        }
     }
 
-    newState->processed = true;
+    clean(newState->matchIds);
+    clean(newState->stickyIds);
+
+    accelerate(newState);
+    newState->processed.store(true, std::memory_order_release);
 }
 
-DfaState* DFA::makeDfa(State* startState) {
+DfaState* DFA::makeDfa(State* startState, State* baseState, unsigned numThreads) {
     clearDfa();
     if (!startState) return nullptr;
-    nfaSetMap.reserve(NFA_RESERVE);
- 
-    DfaState* ans = createEmptyState();
-    this->start = ans;
+
+    if (baseState) {
+        baseStates.push_back(baseState);
+        expandAndClean(baseStates);
+        baseSet.insert(baseStates.begin(), baseStates.end());
+        base = baseState;
+    }
+
+    // a lazy DFA may only ever see a handful of states
+    if (!lazy) nfaSetMap.reserve(NFA_RESERVE);
 
     std::vector<State*> startStates;
     startStates.push_back(startState);
 
     expandAndClean(startStates);
-    nfaSetMap[startStates] = ans;
-    ans->nfaStates = std::move(startStates);
-    
+    DfaState* ans = stateFor(startStates);
+    this->start = ans;
+
     if (lazy) return ans;
 
-    stateStk.push(ans);
+    numThreads = defaultThreads(numThreads);
+    if (numThreads > 1) buildParallel(numThreads);
 
     while (!stateStk.empty()) {
         DfaState* newState = stateStk.top();
         stateStk.pop();
 
         fillNeighbors(newState);
-        newState->nfaStates.clear();
+        newState->nfaStates = {};
     }
 
+    // every state is filled, so sets are never looked up again
+    nfaSetMap = {};
+    scratch.nfaVisited = {};
+
     return ans;
 }
 
-bool DFA::eval(const string& candidate) {
-    DfaState* curr = start;
-    if (curr == nullptr) return candidate.empty();
+// the set lookup of a parallel build, split over locks
+struct SharedSetMap {
+    struct Shard {
+        std::mutex mutex;
+        HashMap<std::vector<State*>, DfaState*> sets;
+    };
+
+    std::array<Shard, SET_SHARDS> shards;
+
+    Shard& shardOf(const std::vector<State*>& set) {
+        return shards[(ankerl::unordered_dense::hash<std::vector<State*>>{}(set) >> 32) % SET_SHARDS];
+    }
+};
+
+void DFA::buildParallel(unsigned numThreads) {
+    WorkStealingPool pool(numThreads);
+    std::vector<FillScratch> bufs(pool.size());
+    std::vector<std::vector<DfaState*>> found(pool.size());
+
+    SharedSetMap setMap;
+    std::mutex arenaMutex;
+
+    // the start state is the only one so far
+    std::vector<DfaState*> level;
+    for (auto& [set, state] : nfaSetMap) setMap.shardOf(set).sets.emplace(set, state);
+    nfaSetMap = {};
+
+    while (!stateStk.empty()) {
+        level.push_back(stateStk.top());
+        stateStk.pop();
+    }
+
+    auto fillOne = [&](DfaState* state, unsigned worker) {
+        fill(state, bufs[worker], [&](std::vector<State*>& nfaStates) {
+            auto& shard = setMap.shardOf(nfaStates);
+            std::lock_guard lock(shard.mutex);
+
+            auto [it, fresh] = shard.sets.try_emplace(nfaStates, nullptr);
+            if (fresh) {
+                {
+                    std::lock_guard arenaLock(arenaMutex);
+                    it->second = createEmptyState();
+                }
+                it->second->nfaStates = std::move(nfaStates);
+                nfaStates.clear();
+                found[worker].push_back(it->second);
+            }
+
+            return it->second;
+        });
+        state->nfaStates = {};
+    };
+
+    // the states first reached from one level make up the next
+    while (!level.empty()) {
+        if (level.size() < MIN_PARALLEL_LEVEL) {
+            for (DfaState* state : level) fillOne(state, 0);
+        }
+        else {
+            uint64_t numChunks = (level.size() + FILLS_PER_CHUNK - 1) / FILLS_PER_CHUNK;
+
+            pool.run(numChunks, [&](uint64_t c, unsigned worker) {
+                uint64_t end = std::min<uint64_t>(level.size(), (c + 1) * FILLS_PER_CHUNK);
+                for (uint64_t i = c * FILLS_PER_CHUNK; i < end; i++) fillOne(level[i], worker);
+            });
+        }
+
+        level.clear();
+        for (auto& states : found) {
+            level.insert(level.end(), states.begin(), states.end());
+            states.clear();
+        }
+    }
+}
+
+void DFA::restart(State* startState) {
+    std::vector<State*> startStates;
+    startStates.push_back(startState);
+
+    expandAndClean(startStates);
+    start = stateFor(startStates);
+}
+
+uint64_t DFA::extendBase(State* entry) {
+    std::vector<State*> added;
+    added.push_back(entry);
+    expandAndClean(added);
+
+    baseStates.insert(baseStates.end(), added.begin(), added.end());
+    baseSet.insert(added.begin(), added.end());
+
+    // every state gains the ids of the new base states and the sets they
+    // move to, the same for all states
+    DfaState probe;
+    auto& stateRanges = scratch.stateRanges;
+    stateRanges.clear();
+    for (State* nfaState : added) addRanges(nfaState, &probe, stateRanges);
+
+    clean(probe.matchIds);
+    clean(probe.stickyIds);
+    clean(stateRanges);
+    reconcile(stateRanges, scratch.stateSetRanges, scratch);
+
+    std::vector<Interval<std::vector<State*>>> extra;
+    for (auto& [l, r, nfaStates] : scratch.stateSetRanges) {
+        clean(nfaStates);
+        expandAndClean(nfaStates);
+        if (!nfaStates.empty()) extra.push_back({l, r, std::move(nfaStates)});
+    }
+
+    // per extra range, the state each old target grows into
+    std::vector<HashMap<DfaState*, DfaState*>> grown(extra.size());
+    std::vector<Interval<DfaState*>> neighbors;
+    std::vector<State*> set;
+
+    uint64_t patched = 0;
+    uint64_t count = nfaSetMap.size();
+
+    for (uint64_t i = 0; i < count; i++) {
+        DfaState* state = nfaSetMap.values()[i].second;
+        if (!state->processed) continue;
+
+        // old neighbors and extra ranges are both sorted, swept together
+        const auto& old = state->neighbors;
+        uint64_t a = 0, b = 0, pos = 0;
+        bool changed = !probe.matchIds.empty();
+        neighbors.clear();
+
+        while (pos <= MAX_CHAR) {
+            while (a < old.size() && old[a].r < pos) a++;
+            while (b < extra.size() && extra[b].r < pos) b++;
+
+            bool inOld = a < old.size() && old[a].l <= pos;
+            bool inExtra = b < extra.size() && extra[b].l <= pos;
+
+            uint64_t next = static_cast<uint64_t>(MAX_CHAR) + 1;
+            if (a < old.size()) next = std::min<uint64_t>(next, inOld ? old[a].r + 1ULL : old[a].l);
+            if (b < extra.size()) next = std::min<uint64_t>(next, inExtra ? extra[b].r + 1ULL : extra[b].l);
+
+            DfaState* target = inOld ? old[a].item : nullptr;
+
+            if (inExtra) {
+                auto [known, fresh] = grown[b].try_emplace(target, nullptr);
+
+                if (fresh) {
+                    set.clear();
+                    if (target) {
+                        std::set_union(target->nfaStates.begin(), target->nfaStates.end(),
+                                       extra[b].item.begin(), extra[b].item.end(),
+                                       std::back_inserter(set));
+                    }
+                    else set = extra[b].item;
+
+                    known->second = stateFor(set);
+                }
+
+                target = known->second;
+                changed = true;
+            }
+
+            if (target) addNeighbor(neighbors, pos, next - 1, target);
+            pos = next;
+        }
+
+        if (!changed) continue;
+
+        state->neighbors.swap(neighbors);
+        state->matchIds.insert(state->matchIds.end(), probe.matchIds.begin(), probe.matchIds.end());
+        state->stickyIds.insert(state->stickyIds.end(), probe.stickyIds.begin(), probe.stickyIds.end());
+        clean(state->matchIds);
+        clean(state->stickyIds);
+        state->isMatch = !state->matchIds.empty();
+
+        state->numEscapes = -1;
+        accelerate(state);
+        patched++;
+    }
+
+    return patched;
+}
+
+uint64_t DFA::dropStates(const HashSet<State*>& dead) {
+    // a pattern's states sit close together in the arena, so most are ruled
+    // out by address
+    auto [low, high] = std::minmax_element(dead.begin(), dead.end());
+    State* first = dead.empty() ? nullptr : *low;
+    State* last = dead.empty() ? nullptr : *high;
+
+    auto isDead = [&dead, first, last](State* state) {
+        return state >= first && state <= last && dead.contains(state);
+    };
+
+    std::erase_if(baseStates, isDead);
+    for (State* state : dead) baseSet.erase(state);
+
+    std::vector<uint32_t> ids;
+    for (State* state : dead) {
+        if (state->type == NodeType::MATCH) ids.push_back(state->c & ~MATCH_STICKY);
+    }
+    clean(ids);
+
+    auto isDeadId = [&ids](uint32_t id) {return std::binary_search(ids.begin(), ids.end(), id);};
+
+    // sets are sorted, only the part within the dead addresses is looked at
+    std::vector<DfaState*> stale;
+    for (const auto& [set, state] : nfaSetMap) {
+        auto it = std::lower_bound(set.begin(), set.end(), first);
+        for (; it != set.end() && *it <= last; ++it) {
+            if (dead.contains(*it)) {
+                stale.push_back(state);
+                break;
+            }
+        }
+    }
+
+    // a state holding dead states is emptied in place and filled again from
+    // the rest of its set. If another state already holds that set, it
+    // becomes the twin every neighbor is moved to
+    for (DfaState* state : stale) nfaSetMap.erase(state->nfaStates);
+
+    HashMap<DfaState*, DfaState*> twins;
 
-    for (char_t c : candidate) {
+    for (DfaState* state : stale) {
+        std::erase_if(state->nfaStates, isDead);
+        state->neighbors = {};
+        state->matchIds = {};
+        state->stickyIds = {};
+        state->isMatch = false;
+        state->processed = false;
+        state->numEscapes = -1;
+
+        auto [it, fresh] = nfaSetMap.try_emplace(state->nfaStates, state);
+        if (!fresh) twins[state] = it->second;
+    }
+
+    if (twins.contains(start)) start = twins[start];
+
+    std::vector<Interval<DfaState*>> neighbors;
+    uint64_t patched = stale.size() - twins.size();
+
+    for (const auto& [set, state] : nfaSetMap) {
+        if (!state->processed) continue;
+
+        bool changed = false;
+        if (!twins.empty()) {
+            neighbors.clear();
+
+            for (auto [l, r, next] : state->neighbors) {
+                auto it = twins.find(next);
+                if (it != twins.end()) {
+                    next = it->second;
+                    changed = true;
+                }
+                addNeighbor(neighbors, l, r, next);
+            }
+
+            if (changed) state->neighbors.swap(neighbors);
+        }
+
+        changed |= std::erase_if(state->matchIds, isDeadId) > 0;
+        changed |= std::erase_if(state->stickyIds, isDeadId) > 0;
+        if (!changed) continue;
+
+        state->isMatch = !state->matchIds.empty();
+        state->numEscapes = -1;
+        accelerate(state);
+        patched++;
+    }
+
+    // the duplicates stay in the arena. Their neighbors and ids were given
+    // back above when they were emptied, their sets go now
+    for (auto [state, twin] : twins) state->nfaStates = {};
+
+    return patched;
+}
+
+uint64_t DFA::numFilled() const {
+    uint64_t count = 0;
+    for (const auto& [set, state] : nfaSetMap) count += state->processed;
+    return count;
+}
+
+uint64_t DFA::memoryUsage() const {
+    uint64_t bytes = sizeof(DFA);
+
+    for (uint64_t i = 0; i < stateArenas.size(); i++) {
+        int count = i + 1 < stateArenas.size() ? arenaSize(i) : arenaIdx;
+        bytes += arenaSize(i) * sizeof(DfaState);
+
+        for (int j = 0; j < count; j++) {
+            const DfaState& state = stateArenas[i][j];
+            bytes += state.neighbors.capacity() * sizeof(Interval<DfaState*>);
+            bytes += state.nfaStates.capacity() * sizeof(State*);
+            bytes += (state.matchIds.capacity() + state.stickyIds.capacity()) * sizeof(uint32_t);
+        }
+    }
+
+    // the base set keeps a copy of each state and a bucket
+    bytes += (baseStates.capacity() + 2 * baseSet.size()) * sizeof(State*);
+
+    // keys are copies of the state sets
+    for (const auto& [set, state] : nfaSetMap) {
+        bytes += sizeof(set) + sizeof(state) + set.capacity() * sizeof(State*);
+    }
+
+    return bytes;
+}
+
+template <bool Collect, CharView View>
+DfaState* DFA::run(DfaState* from, const View& candidate, std::vector<uint32_t>* sticky,
+                   std::vector<uint64_t>* seen) {
+    DfaState* curr = from;
+    if (curr == nullptr || !candidate.acceptable()) return nullptr;
+
+    auto it = candidate.begin();
+    auto end = candidate.end();
+
+    // a state is looked at when the walk enters it, not on every char it
+    // loops on, and ids already seen are not appended again
+    DfaState* collected = nullptr;
+    auto collect = [sticky, seen, &collected](DfaState* state) {
+        if constexpr (Collect) {
+            if (state == collected) return;
+            collected = state;
+
+            for (uint32_t id : state->stickyIds) {
+                uint64_t& word = (*seen)[id >> 6];
+                uint64_t bit = 1ULL << (id & 63);
+                if (word & bit) continue;
+
+                word |= bit;
+                sticky->push_back(id);
+            }
+        }
+    };
+
+    while (it != end) {
         if (!curr->processed) fillNeighbors(curr);
-        curr = findNeighbor(curr, c);
-        if (curr == nullptr) return false;
+        collect(curr);
+
+        // self-looping state, skip straight to the next escaping char
+        if (curr->numEscapes >= 0) {
+            it.ptr = skipSelfLoop(curr, it.ptr, end.ptr);
+            if (it == end) break;
+        }
+
+        if constexpr (std::is_same_v<View, UTF8View>) {
+            // ascii runs are stepped bytewise without decoding
+            const char* blockEnd = end.ptr - it.ptr > ASCII_BLOCK ? it.ptr + ASCII_BLOCK : end.ptr;
+            const char* asciiEnd = it.ptr + asciiPrefix(it.ptr, blockEnd);
+
+            if (it.ptr != asciiEnd) {
+                while (it.ptr != asciiEnd) {
+                    curr = findNeighbor(curr, static_cast<uint8_t>(*it.ptr++));
+                    if (curr == nullptr) return nullptr;
+                    if (!curr->processed) fillNeighbors(curr);
+                    collect(curr);
+                    if (curr->numEscapes >= 0) break;
+                }
+                continue;
+            }
+        }
+
+        curr = findNeighbor(curr, *it);
+        if (curr == nullptr) return nullptr;
+        ++it;
     }
     if (!curr->processed) fillNeighbors(curr);
-    return curr->isMatch;
+    collect(curr);
+    return curr;
+}
+
+template <CharView View>
+bool DFA::eval(const View& candidate) {
+    if (start == nullptr) return candidate.empty();
+
+    DfaState* curr = walk(candidate);
+    return curr && curr->isMatch;
 }
 
+template DfaState* DFA::run<false>(DfaState*, const ByteView&, std::vector<uint32_t>*,
+                                   std::vector<uint64_t>*);
+template DfaState* DFA::run<false>(DfaState*, const UTF8View&, std::vector<uint32_t>*,
+                                   std::vector<uint64_t>*);
+template DfaState* DFA::run<false>(DfaState*, const UTF16View&, std::vector<uint32_t>*,
+                                   std::vector<uint64_t>*);
+template DfaState* DFA::run<false>(DfaState*, const UTF32View&, std::vector<uint32_t>*,
+                                   std::vector<uint64_t>*);
+template DfaState* DFA::run<true>(DfaState*, const ByteView&, std::vector<uint32_t>*,
+                                  std::vector<uint64_t>*);
+template DfaState* DFA::run<true>(DfaState*, const UTF8View&, std::vector<uint32_t>*,
+                                  std::vector<uint64_t>*);
+template DfaState* DFA::run<true>(DfaState*, const UTF16View&, std::vector<uint32_t>*,
+                                  std::vector<uint64_t>*);
+template DfaState* DFA::run<true>(DfaState*, const UTF32View&, std::vector<uint32_t>*,
+                                  std::vector<uint64_t>*);
+
+template bool DFA::eval(const ByteView&);
+template bool DFA::eval(const UTF8View&);
+template bool DFA::eval(const UTF16View&);
+template bool DFA::eval(const UTF32View&);
@@ -1,8 +1,12 @@
 #pragma once
 
 #include "nfa.hpp"
+#include "simd.hpp"
 
 #include <map>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
 #include <utility>
 #include <algorithm>
 #include <bitset>
@@ -13,9 +17,32 @@
 
 // constants
 
+// state arenas double from DFA_MIN_ARENA up to DFA_ARENA_SIZE states, so
+// small DFAs stay small
+constexpr int DFA_MIN_ARENA = 16;
 constexpr int DFA_ARENA_SIZE = 4096;
 constexpr int NFA_RESERVE = 65536;
-constexpr char_t MAX_CHAR = std::numeric_limits<char_t>::max();
+
+// a state is accelerated if it loops to itself on all but this many chars
+constexpr int MAX_ESCAPES = 3;
+
+// ascii runs are detected at most this many bytes ahead while matching
+constexpr int ASCII_BLOCK = 256;
+
+// candidates stepped together by evalLockstep
+constexpr int LOCKSTEP_LANES = 8;
+
+// an eager DFA built on several threads is filled a level at a time, in
+// chunks of this many states. Smaller levels are filled on one thread
+constexpr uint64_t FILLS_PER_CHUNK = 16;
+constexpr uint64_t MIN_PARALLEL_LEVEL = 64;
+
+// a set with at most this many states is swept with one bit per state, so
+// a big class is walked once per state instead of sorted and reconciled
+constexpr uint64_t MAX_SWEEP_SOURCES = 64;
+
+// the set lookup of a parallel build is split over this many locks
+constexpr uint64_t SET_SHARDS = 64;
 
 constexpr bool ADD = true;
 constexpr bool REMOVE = false;
@@ -90,22 +117,51 @@ struct SparseSet {
 
 struct DfaState {
     std::vector<Interval<DfaState*>> neighbors;
+
+    // without the base states, which every state holds
     std::vector<State*> nfaStates;
+
+    // ids held by the MATCH states of a set, ascending. The sticky ones also
+    // match every candidate passing through this state
+    std::vector<uint32_t> matchIds;
+    std::vector<uint32_t> stickyIds;
     bool isMatch = false;
-    bool processed = false;
+
+    // set once the state is filled, after everything above. A LazyBuilder
+    // may fill states while another thread matches
+    std::atomic<bool> processed = false;
+
+    // ascii chars that leave a self-looping state, -1 if not accelerated
+    int8_t numEscapes = -1;
+    char escapes[MAX_ESCAPES];
 };
 
-class DFA {
-private:
-    bool lazy = false;
+// buffers reused from one fill to the next, a parallel build gives each
+// worker its own
+struct FillScratch {
+    // the chars a state of the set reads, walked an interval at a time
+    struct Source {
+        std::span<const ClassInterval> ranges;  // empty for a single interval
+        ClassInterval single;
+        State* out;
+        uint64_t pos = 0;
+        bool active = false;
+
+        uint64_t size() const {return ranges.empty() ? 1 : ranges.size();}
+        const ClassInterval& at(uint64_t i) const {return ranges.empty() ? single : ranges[i];}
+    };
+
+    std::vector<Source> sources;
+
+    // the target of each combination of sources live over some chars
+    HashMap<uint64_t, DfaState*> maskTargets;
 
-    int arenaIdx = DFA_ARENA_SIZE;
-    std::vector<std::unique_ptr<DfaState[]>> stateArenas;
     std::vector<Interval<State*>> stateRanges;
     std::vector<Interval<std::vector<State*>>> stateSetRanges;
-    std::stack<DfaState*, std::vector<DfaState*>> stateStk;
 
-    HashMap<std::vector<State*>, DfaState*> nfaSetMap;
+    // targets resolved while filling one state, the ranges of a big class
+    // mostly lead to the same few sets
+    HashMap<std::vector<State*>, DfaState*> targetMap;
 
     // for expandAndClean
     HashSet<State*> nfaVisited;
@@ -115,8 +171,8 @@ private:
     // for reconcile
     std::vector<Interval<std::vector<uint64_t>>> idxRes;
     SparseSet<uint64_t> itemSet;
-    std::vector<uint64_t> freqs; 
-      
+    std::vector<uint64_t> freqs;
+
     struct SweepItem {
         uint64_t point;
         uint64_t idx;
@@ -126,29 +182,84 @@ private:
     };
 
     std::vector<SweepItem> line;
+};
+
+// shared by a lazy DFA and the LazyBuilder filling it in the background.
+// Every fill holds the mutex, and the states the matching thread had to
+// fill itself are handed to the builder as misses while it listens
+struct FillShare {
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<DfaState*> misses;
+    bool listening = false;
+
+    // matching threads blocked on the mutex, the builder steps aside for them
+    std::atomic<int> waiting = 0;
+};
+
+class DFA {
+private:
+    friend class LazyBuilder;
+
+    bool lazy = false;
+    FillShare* share = nullptr;
+
+    int arenaIdx = 0;
+    int stateCount = 0;
+    std::vector<std::unique_ptr<DfaState[]>> stateArenas;
+    std::stack<DfaState*, std::vector<DfaState*>> stateStk;
+
+    HashMap<std::vector<State*>, DfaState*> nfaSetMap;
+
+    // the closure of NFA::base, left out of the sets so thousands of
+    // patterns waiting for their first char are not copied into each
+    State* base = nullptr;
+    std::vector<State*> baseStates;
+    HashSet<State*> baseSet;
+
+    FillScratch scratch;
+
+    template <bool Collect, CharView View>
+    DfaState* run(DfaState* from, const View& candidate, std::vector<uint32_t>* sticky,
+                  std::vector<uint64_t>* seen);
+
+    void addRanges(State* nfaState, DfaState* owner, std::vector<Interval<State*>>& ranges);
+
+    // stateOf gives the state holding each target set
+    template <typename Lookup>
+    void fill(DfaState* newState, FillScratch& buf, Lookup stateOf);
+    void fill(DfaState* newState);
+
+    // fills the states breadth first, each level shared out over a pool
+    void buildParallel(unsigned numThreads);
+
+    // the state holding this set, created unfilled if it is new
+    DfaState* stateFor(std::vector<State*>& nfaStates);
 
 public:
     DfaState* start = nullptr;
 
     inline int numStates() {
-        return DFA_ARENA_SIZE * (stateArenas.size() - 1) + arenaIdx;
+        return stateCount;
+    }
+
+    static int arenaSize(uint64_t idx) {
+        return idx < 8 ? DFA_MIN_ARENA << idx : DFA_ARENA_SIZE;
     }
 
     void clearDfa() {
         start = nullptr;
         stateArenas.clear();
-        arenaIdx = DFA_ARENA_SIZE;
+        arenaIdx = 0;
+        stateCount = 0;
 
         nfaSetMap.clear();
-        nfaVisited.clear();
-        newStates.clear();
 
-        stateRanges.clear();
-        stateSetRanges.clear();
+        base = nullptr;
+        baseStates.clear();
+        baseSet.clear();
 
-        idxRes.clear();
-        itemSet.clear();
-        freqs.clear();
+        scratch = FillScratch();
     }
     
     template <Comparable T>
@@ -161,11 +272,17 @@ public:
     template <typename T>
     void reconcile(
         std::vector<Interval<T>>& intervals,
-        std::vector<Interval<std::vector<T>>>& dest
+        std::vector<Interval<std::vector<T>>>& dest,
+        FillScratch& buf
     ) {
         dest.clear();
         if (intervals.empty()) return;
 
+        auto& line = buf.line;
+        auto& idxRes = buf.idxRes;
+        auto& itemSet = buf.itemSet;
+        auto& freqs = buf.freqs;
+
         line.clear();
         uint64_t N = 0;
 
@@ -220,7 +337,16 @@ public:
         }
     } 
 
-    DfaState* findNeighbor(DfaState* curr, char_t c) {
+    // adjacent ranges into the same state are merged
+    static void addNeighbor(std::vector<Interval<DfaState*>>& neighbors, char_t l, char_t r,
+                            DfaState* state) {
+        if (!neighbors.empty() && neighbors.back().item == state && neighbors.back().r + 1 == l) {
+            neighbors.back().r = r;
+        }
+        else neighbors.push_back({l, r, state});
+    }
+
+    static DfaState* findNeighbor(DfaState* curr, char_t c) {
         auto& neighbors = curr->neighbors; 
         if (!neighbors.size()) return nullptr;
 
@@ -242,25 +368,155 @@ public:
 
     DfaState* createEmptyState() {
 
-        if (arenaIdx >= DFA_ARENA_SIZE) {
-            auto uPtr = std::make_unique<DfaState[]>(DFA_ARENA_SIZE);
+        if (stateArenas.empty() || arenaIdx >= arenaSize(stateArenas.size() - 1)) {
+            auto uPtr = std::make_unique<DfaState[]>(arenaSize(stateArenas.size()));
             stateArenas.push_back(std::move(uPtr));
             arenaIdx = 0;
         }
-        
+
+        stateCount++;
         return &stateArenas.back()[arenaIdx++];
     }
     
-    void expandAndClean(std::vector<State*>& nfaStates);
+    inline const char* skipSelfLoop(DfaState* curr, const char* ptr,
+                                    const char* end) {
+        return findAnyByte(ptr, end, curr->escapes, curr->numEscapes);
+    }
+
+    template <typename Unit>
+    inline const Unit* skipSelfLoop(DfaState* curr, const Unit* ptr,
+                                    const Unit* end) {
+        return findAnyUnit(ptr, end, curr->escapes, curr->numEscapes);
+    }
+
+    // approximate heap bytes held by the states and the set lookup
+    uint64_t memoryUsage() const;
+
+    void accelerate(DfaState* state);
+    void expandAndClean(std::vector<State*>& nfaStates, FillScratch& buf);
+    void expandAndClean(std::vector<State*>& nfaStates) {expandAndClean(nfaStates, scratch);}
     void fillNeighbors(DfaState* newState);
-    DfaState* makeDfa(State* startState);
 
-    bool eval(const string& candidate);
+    // an eager DFA is built on numThreads threads, 0 uses every core
+    DfaState* makeDfa(State* startState, State* baseState = nullptr, unsigned numThreads = 1);
+
+    // in place updates of a lazy DFA whose NFA grew or lost a pattern, the
+    // filled states survive and the count of states patched is returned.
+    // restart follows a new start set, extendBase a pattern hung off the
+    // base and dropStates the removal of the given NFA states
+    void restart(State* startState);
+    uint64_t extendBase(State* entry);
+    uint64_t dropStates(const HashSet<State*>& dead);
+
+    // filled states a lazy DFA still reaches through its set lookup
+    uint64_t numFilled() const;
+
+    // the state the candidate ends in, nullptr if it falls off the DFA
+    template <CharView View>
+    DfaState* walk(const View& candidate) {
+        return run<false>(start, candidate, nullptr, nullptr);
+    }
+
+    // also appends the sticky ids of every state passed, each once. seen
+    // has a bit for every id, those set are skipped and the appended ones
+    // get set, so the caller clears them before the next walk
+    template <CharView View>
+    DfaState* walk(const View& candidate, std::vector<uint32_t>& sticky,
+                   std::vector<uint64_t>& seen) {
+        return run<true>(start, candidate, &sticky, &seen);
+    }
+
+    // the walk of a candidate that starts in state from
+    template <CharView View>
+    DfaState* walkFrom(DfaState* from, const View& candidate) {
+        return run<false>(from, candidate, nullptr, nullptr);
+    }
+
+    template <CharView View>
+    bool eval(const View& candidate);
+
+    // matches candidate(0) to candidate(count - 1) and sets bit i of bits
+    // for each match. Lanes candidates are stepped a char at a time in turn,
+    // so the misses of one lane's next state overlap with the others' work,
+    // and a lane that finishes takes the next candidate
+    template <int Lanes = LOCKSTEP_LANES, typename Get>
+    void evalLockstep(uint64_t count, Get candidate, uint64_t* bits) {
+        using View = decltype(candidate(0));
+        using Iterator = decltype(candidate(0).begin());
+
+        struct Lane {
+            Iterator it, end;
+            DfaState* curr;
+            uint64_t idx;
+        };
+
+        auto finish = [bits](uint64_t idx, bool matched) {
+            if (matched) bits[idx >> 6] |= 1ULL << (idx & 63);
+        };
+
+        // the next candidate that needs stepping, short ones are done here
+        uint64_t next = 0;
+        auto load = [&](Lane& lane) {
+            while (next < count) {
+                uint64_t idx = next++;
+                View view = candidate(idx);
+
+                if (start == nullptr) {
+                    finish(idx, view.empty());
+                    continue;
+                }
+                if (!view.acceptable()) continue;
+
+                lane = {view.begin(), view.end(), start, idx};
+                if (lane.it != lane.end) return true;
+
+                if (!start->processed) fillNeighbors(start);
+                finish(idx, start->isMatch);
+            }
+            return false;
+        };
+
+        Lane lanes[Lanes];
+        int active = 0;
+        while (active < Lanes && load(lanes[active])) active++;
+
+        while (active) {
+            // the rows every lane searches next, their states were
+            // prefetched on the previous round
+            for (int k = 0; k < active; k++) {
+                if (!lanes[k].curr->processed) fillNeighbors(lanes[k].curr);
+                __builtin_prefetch(lanes[k].curr->neighbors.data());
+            }
+
+            for (int k = 0; k < active;) {
+                Lane& lane = lanes[k];
+                DfaState* curr = findNeighbor(lane.curr, *lane.it);
+                ++lane.it;
+
+                if (curr && lane.it != lane.end) {
+                    lane.curr = curr;
+                    __builtin_prefetch(curr);
+                    k++;
+                    continue;
+                }
+
+                if (curr) {
+                    if (!curr->processed) fillNeighbors(curr);
+                    finish(lane.idx, curr->isMatch);
+                }
+
+                if (load(lane)) k++;
+                else lane = lanes[--active];
+            }
+        }
+    }
 
     DFA() = default;
 
-    DFA(const NFA& nfa, bool lazy = false) : lazy(lazy) {
-        makeDfa(nfa.start);
+    // numThreads only applies to eager DFAs, which come out the same on any
+    // number of threads up to the order of the states
+    DFA(const NFA& nfa, bool lazy = false, unsigned numThreads = 1) : lazy(lazy) {
+        makeDfa(nfa.start, nfa.base, numThreads);
     }
 };
 
@@ -0,0 +1,398 @@
+#include "jit.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+// x86-64 condition codes, as the second byte of a 0F jcc rel32
+constexpr uint8_t JB = 0x82;
+constexpr uint8_t JAE = 0x83;
+constexpr uint8_t JNE = 0x85;
+constexpr uint8_t JBE = 0x86;
+
+// machine code with forward references to labels, patched by resolve()
+struct Assembler {
+    static constexpr uint64_t NO_BASE = ~0ULL;
+
+    struct Fixup {
+        uint64_t at;
+        uint64_t label;
+        uint64_t base;  // label the offset is taken from, NO_BASE for rip
+    };
+
+    std::vector<uint8_t> code;
+    std::vector<int64_t> labels;
+    std::vector<Fixup> fixups;
+
+    uint64_t newLabel() {
+        labels.push_back(-1);
+        return labels.size() - 1;
+    }
+
+    void bind(uint64_t label) {
+        labels[label] = code.size();
+    }
+
+    void emit(std::initializer_list<uint8_t> bytes) {
+        code.insert(code.end(), bytes);
+    }
+
+    void emit32(uint32_t value) {
+        for (int i = 0; i < 4; i++) code.push_back(value >> (8 * i));
+    }
+
+    // a disp32 relative to the end of the field, which ends the instruction
+    void rel32(uint64_t label) {
+        fixups.push_back({code.size(), label, NO_BASE});
+        emit32(0);
+    }
+
+    // a jump table entry relative to the start of its table
+    void entry32(uint64_t label, uint64_t table) {
+        fixups.push_back({code.size(), label, table});
+        emit32(0);
+    }
+
+    void jmp(uint64_t label) {
+        emit({0xE9});
+        rel32(label);
+    }
+
+    void jcc(uint8_t condition, uint64_t label) {
+        emit({0x0F, condition});
+        rel32(label);
+    }
+
+    // cmp eax, imm
+    void cmpEax(uint32_t imm) {
+        if (imm < 0x80) emit({0x83, 0xF8, static_cast<uint8_t>(imm)});
+        else {
+            emit({0x3D});
+            emit32(imm);
+        }
+    }
+
+    // mov eax, imm; ret
+    void ret(uint32_t value) {
+        if (value == 0) emit({0x31, 0xC0});
+        else {
+            emit({0xB8});
+            emit32(value);
+        }
+        emit({0xC3});
+    }
+
+    void align(uint64_t n) {
+        while (code.size() % n) code.push_back(0xCC);
+    }
+
+    void resolve() {
+        for (auto [at, label, base] : fixups) {
+            int64_t from = base == NO_BASE ? at + 4 : labels[base];
+            int32_t disp = static_cast<int32_t>(labels[label] - from);
+            std::memcpy(&code[at], &disp, sizeof(disp));
+        }
+    }
+};
+
+// states reachable from start, filling lazy ones on the way. On failure
+// none are kept, the states past the limit were never filled
+bool JitDfa::freeze(DFA& dfa) {
+    states.push_back(dfa.start);
+    ids[dfa.start] = 0;
+
+    for (uint64_t i = 0; i < states.size(); i++) {
+        if (!states[i]->processed) dfa.fillNeighbors(states[i]);
+
+        for (auto& [l, r, next] : states[i]->neighbors) {
+            if (ids.try_emplace(next, states.size()).second) states.push_back(next);
+        }
+
+        if (states.size() > JIT_MAX_STATES) {
+            states.clear();
+            ids.clear();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// registers: rdi ptr, rsi end, r9 stop, eax the current byte; rdx, r8 and
+// xmm0-2 are scratch. Nothing callee-saved is touched and nothing is called
+std::vector<uint8_t> JitDfa::assemble() const {
+    Assembler as;
+    uint64_t n = states.size();
+    bool utf8 = encoding == Encoding::UTF8;
+    uint32_t maxByte = utf8 ? 0x7F : 0xFF;
+
+    // head is where transitions land, the escape scan of accelerated states
+    std::vector<uint64_t> head(n), block(n), bail(n);
+    for (uint64_t i = 0; i < n; i++) {
+        head[i] = as.newLabel();
+        block[i] = states[i]->numEscapes >= 0 ? as.newLabel() : head[i];
+        bail[i] = as.newLabel();
+    }
+
+    uint64_t match = as.newLabel();
+    uint64_t reject = as.newLabel();
+    uint64_t entries = as.newLabel();
+
+    struct Broadcast {
+        uint64_t label;
+        uint8_t byte;
+    };
+    std::vector<Broadcast> broadcasts;
+
+    // enter at the state in rdx
+    as.emit({0x49, 0x89, 0xC9});                    // mov r9, rcx
+    as.emit({0x4C, 0x8D, 0x05});                    // lea r8, [rip + entries]
+    as.rel32(entries);
+    as.emit({0x49, 0x63, 0x04, 0x90});              // movsxd rax, dword [r8 + rdx * 4]
+    as.emit({0x4C, 0x01, 0xC0});                    // add rax, r8
+    as.emit({0xFF, 0xE0});                          // jmp rax
+
+    struct Range {
+        uint32_t l, r;
+        uint64_t target;
+    };
+    std::vector<Range> ranges;
+
+    for (uint64_t i = 0; i < n; i++) {
+        const DfaState* state = states[i];
+        bool accelerated = state->numEscapes >= 0;
+
+        // 16 bytes at a time until one of them is an escape
+        if (accelerated) {
+            uint64_t found = as.newLabel();
+
+            as.bind(head[i]);
+            as.emit({0x48, 0x89, 0xF0});            // mov rax, rsi
+            as.emit({0x48, 0x29, 0xF8});            // sub rax, rdi
+            as.emit({0x48, 0x83, 0xF8, 0x10});      // cmp rax, 16
+            as.jcc(JB, block[i]);
+            as.emit({0xF3, 0x0F, 0x6F, 0x07});      // movdqu xmm0, [rdi]
+            as.emit({0x66, 0x0F, 0xEF, 0xD2});      // pxor xmm2, xmm2
+
+            for (int j = 0; j < state->numEscapes; j++) {
+                uint64_t label = as.newLabel();
+                broadcasts.push_back({label, static_cast<uint8_t>(state->escapes[j])});
+
+                as.emit({0xF3, 0x0F, 0x6F, 0x0D});  // movdqu xmm1, [rip + broadcast]
+                as.rel32(label);
+                as.emit({0x66, 0x0F, 0x74, 0xC8});  // pcmpeqb xmm1, xmm0
+                as.emit({0x66, 0x0F, 0xEB, 0xD1});  // por xmm2, xmm1
+            }
+
+            as.emit({0x66, 0x0F, 0xD7, 0xC2});      // pmovmskb eax, xmm2
+            as.emit({0x85, 0xC0});                  // test eax, eax
+            as.jcc(JNE, found);
+            as.emit({0x48, 0x83, 0xC7, 0x10});      // add rdi, 16
+            as.jmp(head[i]);
+
+            as.bind(found);
+            as.emit({0x0F, 0xBC, 0xC0});            // bsf eax, eax
+            as.emit({0x48, 0x01, 0xC7});            // add rdi, rax
+        }
+
+        as.bind(block[i]);
+        as.emit({0x48, 0x39, 0xF7});                // cmp rdi, rsi
+        as.jcc(JAE, state->isMatch ? match : reject);
+        as.emit({0x0F, 0xB6, 0x07});                // movzx eax, byte [rdi]
+
+        // multibyte chars are stepped outside, except by accelerated states
+        // which loop on all of them
+        if (utf8 && !accelerated) {
+            as.cmpEax(0x80);
+            as.jcc(JAE, bail[i]);
+        }
+        as.emit({0x48, 0xFF, 0xC7});                // inc rdi
+        if (utf8 && accelerated) {
+            as.cmpEax(0x80);
+            as.jcc(JAE, head[i]);
+        }
+
+        ranges.clear();
+        for (auto& [l, r, next] : state->neighbors) {
+            if (l > maxByte) break;
+
+            uint32_t hi = std::min<uint32_t>(r, maxByte);
+            uint64_t target = head[ids.find(next)->second];
+
+            if (!ranges.empty() && ranges.back().r + 1 == l && ranges.back().target == target) {
+                ranges.back().r = hi;
+            }
+            else ranges.push_back({static_cast<uint32_t>(l), hi, target});
+        }
+
+        if (ranges.size() > JIT_MAX_COMPARES) {
+            uint64_t table = as.newLabel();
+
+            as.emit({0x48, 0x8D, 0x15});            // lea rdx, [rip + table]
+            as.rel32(table);
+            as.emit({0x48, 0x63, 0x04, 0x82});      // movsxd rax, dword [rdx + rax * 4]
+            as.emit({0x48, 0x01, 0xD0});            // add rax, rdx
+            as.emit({0xFF, 0xE0});                  // jmp rax
+
+            as.align(4);
+            as.bind(table);
+
+            uint32_t c = 0;
+            for (auto [l, r, target] : ranges) {
+                for (; c < l; c++) as.entry32(reject, table);
+                for (; c <= r; c++) as.entry32(target, table);
+            }
+            for (; c <= maxByte; c++) as.entry32(reject, table);
+        }
+        else {
+            // the first range ending at or above the byte, then its lower end
+            std::vector<uint64_t> hits;
+            for (auto [l, r, target] : ranges) {
+                hits.push_back(as.newLabel());
+                as.cmpEax(r);
+                as.jcc(JBE, hits.back());
+            }
+            as.jmp(reject);
+
+            for (uint64_t k = 0; k < ranges.size(); k++) {
+                uint32_t covered = k ? ranges[k - 1].r + 1 : 0;
+
+                as.bind(hits[k]);
+                if (ranges[k].l > covered) {
+                    as.cmpEax(ranges[k].l);
+                    as.jcc(JB, reject);
+                }
+                as.jmp(ranges[k].target);
+            }
+        }
+
+        if (utf8 && !accelerated) {
+            as.bind(bail[i]);
+            as.emit({0x49, 0x89, 0x39});            // mov [r9], rdi
+            as.ret(2 + i);
+        }
+    }
+
+    as.bind(match);
+    as.ret(1);
+    as.bind(reject);
+    as.ret(0);
+
+    as.align(4);
+    as.bind(entries);
+    for (uint64_t i = 0; i < n; i++) as.entry32(head[i], entries);
+
+    as.align(16);
+    for (auto [label, byte] : broadcasts) {
+        as.bind(label);
+        for (int j = 0; j < 16; j++) as.code.push_back(byte);
+    }
+
+    as.resolve();
+    return std::move(as.code);
+}
+
+JitDfa::JitDfa(DFA& dfa, Encoding encoding) : encoding(encoding) {
+    if (encoding != Encoding::BYTES && encoding != Encoding::UTF8) {
+        throw std::invalid_argument("Only byte and utf8 DFAs can be compiled");
+    }
+    if (dfa.start == nullptr) return;
+    if (!freeze(dfa)) {
+        source = &dfa;
+        return;
+    }
+
+#if defined(__x86_64__) && defined(__linux__)
+    std::vector<uint8_t> bytes = assemble();
+
+    // written while writable, then flipped to executable
+    void* mem = mmap(nullptr, bytes.size(), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return;
+
+    std::memcpy(mem, bytes.data(), bytes.size());
+    if (mprotect(mem, bytes.size(), PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, bytes.size());
+        return;
+    }
+
+    code = mem;
+    codeSize = bytes.size();
+    entry = reinterpret_cast<Entry>(mem);
+#endif
+}
+
+JitDfa::JitDfa(JitDfa&& other) noexcept {
+    *this = std::move(other);
+}
+
+JitDfa& JitDfa::operator=(JitDfa&& other) noexcept {
+    release();
+    encoding = other.encoding;
+    states = std::move(other.states);
+    ids = std::move(other.ids);
+    source = std::exchange(other.source, nullptr);
+    code = std::exchange(other.code, nullptr);
+    codeSize = std::exchange(other.codeSize, 0);
+    entry = std::exchange(other.entry, nullptr);
+    return *this;
+}
+
+void JitDfa::release() {
+#if defined(__x86_64__) && defined(__linux__)
+    if (code) munmap(code, codeSize);
+#endif
+    code = nullptr;
+    entry = nullptr;
+}
+
+// without native code the frozen states are stepped one char at a time
+template <CharView View>
+static bool interpret(DfaState* curr, const View& candidate) {
+    if (curr == nullptr) return candidate.empty();
+    if (!candidate.acceptable()) return false;
+
+    for (char_t c : candidate) {
+        curr = DFA::findNeighbor(curr, c);
+        if (curr == nullptr) return false;
+    }
+    return curr->isMatch;
+}
+
+bool JitDfa::eval(const ByteView& candidate) const {
+    if (source) return source->eval(candidate);
+    if (!entry) return interpret(states.empty() ? nullptr : states[0], candidate);
+
+    // every byte is handled natively
+    auto ptr = reinterpret_cast<const uint8_t*>(candidate.data());
+    return entry(ptr, ptr + candidate.size(), 0, &ptr);
+}
+
+bool JitDfa::eval(const UTF8View& candidate) const {
+    if (source) return source->eval(candidate);
+    if (!entry) return interpret(states.empty() ? nullptr : states[0], candidate);
+    if (!candidate.acceptable()) return false;
+
+    auto ptr = reinterpret_cast<const uint8_t*>(candidate.data());
+    auto end = ptr + candidate.size();
+    uint64_t state = 0;
+
+    while (true) {
+        uint64_t res = entry(ptr, end, state, &ptr);
+        if (res < 2) return res;
+
+        // a multibyte char, decoded and stepped the way DFA::eval does
+        int len;
+        char_t c = decodeUtf8(reinterpret_cast<const char*>(ptr),
+                              reinterpret_cast<const char*>(end), len, candidate.mode);
+
+        DfaState* next = DFA::findNeighbor(states[res - 2], c);
+        if (next == nullptr) return false;
+
+        ptr += len;
+        state = ids.find(next)->second;
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "dfa.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// constants
+
+#if defined(__x86_64__) && defined(__linux__)
+constexpr bool JIT_SUPPORTED = true;
+#else
+constexpr bool JIT_SUPPORTED = false;
+#endif
+
+// DFAs with more states are left to the interpreter
+constexpr uint64_t JIT_MAX_STATES = 1 << 16;
+
+// transitions with more ranges than this dispatch through a jump table
+constexpr uint64_t JIT_MAX_COMPARES = 8;
+
+// data structures
+
+// native code for a DFA, one block of x86-64 per state. Blocks read a byte,
+// compare it against the ranges leaving the state (or index a jump table)
+// and jump straight to the next block; accelerated states scan 16 bytes at
+// a time for their escapes. Utf8 candidates run natively while they are
+// ascii, every other char is decoded and stepped here before jumping back in
+class JitDfa {
+private:
+    Encoding encoding = Encoding::BYTES;
+    std::vector<DfaState*> states;
+    HashMap<DfaState*, uint64_t> ids;
+
+    // set when the DFA has too many states to freeze, candidates are then
+    // left to DFA::eval
+    DFA* source = nullptr;
+
+    // fn(ptr, end, state, &stop): 0 rejected, 1 matched, 2 + id if the
+    // char at stop has to be stepped from state id outside of native code
+    using Entry = uint64_t (*)(const uint8_t*, const uint8_t*, uint64_t, const uint8_t**);
+
+    void* code = nullptr;
+    size_t codeSize = 0;
+    Entry entry = nullptr;
+
+    bool freeze(DFA& dfa);
+    std::vector<uint8_t> assemble() const;
+    void release();
+
+public:
+    JitDfa() = default;
+
+    // byte and utf8 DFAs only, check compiled() for the fallback. A lazy DFA
+    // is filled here until JIT_MAX_STATES states, so a large one takes as
+    // long as an eager build before it is left to DFA::eval. The DFA has to
+    // outlive the JitDfa
+    JitDfa(DFA& dfa, Encoding encoding);
+
+    JitDfa(JitDfa&& other) noexcept;
+    JitDfa& operator=(JitDfa&& other) noexcept;
+    JitDfa(const JitDfa&) = delete;
+    JitDfa& operator=(const JitDfa&) = delete;
+
+    ~JitDfa() {release();}
+
+    bool compiled() const {
+        return entry != nullptr;
+    }
+
+    uint64_t numStates() const {
+        return states.size();
+    }
+
+    bool eval(const ByteView& candidate) const;
+    bool eval(const UTF8View& candidate) const;
+};
@@ -0,0 +1,118 @@
+#include "lexer.hpp"
+
+Lexer::Lexer(const std::vector<std::string>& patterns, bool lazy, Encoding encoding,
+             uint32_t flags, uint64_t maxNfaStates)
+    : patterns(patterns), encoding(encoding), flags(flags) {
+    std::string_view inlineIcase = "(?i)";
+
+    for (uint32_t id = 0; id < patterns.size(); id++) {
+        std::string_view pattern = patterns[id];
+
+        try {
+            // the inline flag has to stay in front of the anchor
+            bool icase = pattern.starts_with(inlineIcase);
+            if (icase) pattern.remove_prefix(inlineIcase.size());
+
+            // tokens are anchored anyway, anchors written out are dropped
+            if (pattern.starts_with('^')) pattern.remove_prefix(1);
+            if (pattern.ends_with('$') && !escapedAtEnd(ByteView(pattern))) pattern.remove_suffix(1);
+
+            if (pattern.empty()) {
+                throw std::runtime_error("Empty token");
+            }
+
+            std::string source = (icase ? "(?i)^" : "^") + std::string(pattern) + "$";
+            if (escapedAtEnd(ByteView(source))) {
+                throw std::runtime_error("Trailing backslash");
+            }
+
+            Postfix postfix = compilePostfix(source, encoding, flags, maxNfaStates);
+            nfa.start = nfa.link(nfa.addPattern(postfix, id), nfa.start);
+        }
+        catch (const std::exception& e) {
+            throw std::runtime_error("Pattern " + std::to_string(id) + ": " + e.what());
+        }
+    }
+
+    dfa = DFA(nfa, lazy);
+}
+
+template <CharView View>
+Lexeme Lexer::munch(View input, uint64_t pos, bool validate) {
+    auto origin = input.data();
+    input.remove_prefix(pos);
+
+    Lexeme res = {NO_TOKEN, pos, pos};
+    DfaState* curr = dfa.start;
+    if (curr == nullptr) return res;
+
+    if (!curr->processed) dfa.fillNeighbors(curr);
+
+    // every state on the way may end the longest token so far
+    auto it = input.begin();
+    auto end = input.end();
+    while (it != end) {
+        curr = DFA::findNeighbor(curr, *it);
+        if (curr == nullptr) break;
+        ++it;
+
+        if (!curr->processed) dfa.fillNeighbors(curr);
+        if (curr->isMatch) {
+            res.id = curr->matchIds.front();
+            res.end = it.ptr - origin;
+        }
+    }
+
+    // only the chars read are checked, so a loop over next stays linear
+    input.remove_suffix(end.ptr - it.ptr);
+    if (validate && !input.acceptable()) {
+        throw std::runtime_error("Malformed input at offset " + std::to_string(pos));
+    }
+
+    return res;
+}
+
+template <CharView View>
+std::vector<Lexeme> Lexer::split(const View& input) {
+    if (!input.acceptable()) {
+        throw std::runtime_error("Malformed input");
+    }
+
+    std::vector<Lexeme> res;
+
+    for (uint64_t pos = 0; pos < input.size();) {
+        Lexeme lexeme = munch(input, pos, false);
+        if (lexeme.id == NO_TOKEN) {
+            throw std::runtime_error("No token matches at offset " + std::to_string(pos));
+        }
+
+        res.push_back(lexeme);
+        pos = lexeme.end;
+    }
+
+    return res;
+}
+
+Lexeme Lexer::next(std::string_view input, uint64_t pos) {
+    if (encoding == Encoding::BYTES) return munch(ByteView(input), pos, true);
+
+    requireEncoding(encoding, Encoding::UTF8);
+    return munch(UTF8View(input, utf8Mode), pos, true);
+}
+
+std::vector<Lexeme> Lexer::tokenize(std::string_view input) {
+    if (encoding == Encoding::BYTES) return split(ByteView(input));
+
+    requireEncoding(encoding, Encoding::UTF8);
+    return split(UTF8View(input, utf8Mode));
+}
+
+std::vector<Lexeme> Lexer::tokenize(std::u16string_view input) {
+    requireEncoding(encoding, Encoding::UTF16);
+    return split(UTF16View(input, utf8Mode));
+}
+
+std::vector<Lexeme> Lexer::tokenize(std::u32string_view input) {
+    requireEncoding(encoding, Encoding::UTF32);
+    return split(UTF32View(input));
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "cache.hpp"
+
+// constants
+
+// id of a lexeme no token matched
+constexpr uint32_t NO_TOKEN = std::numeric_limits<uint32_t>::max();
+
+// data structures
+
+// a token found in the input, [begin, end) in code units
+struct Lexeme {
+    uint32_t id;
+    uint64_t begin;
+    uint64_t end;
+
+    auto operator<=>(const Lexeme&) const = default;
+};
+
+// tokenizes with an ordered list of token patterns compiled into one
+// anchored DFA. The MATCH states hold the token ids, so the ids a state
+// accepts are sorted by priority and the first one wins. At every position
+// the DFA is run once for all tokens and the longest match is taken
+class Lexer {
+private:
+    std::vector<std::string> patterns;
+    NFA nfa;
+    DFA dfa;
+    Encoding encoding = Encoding::UTF8;
+    uint32_t flags = 0;
+    Utf8Mode utf8Mode = Utf8Mode::LENIENT;
+
+    // validate checks the chars read against the utf8 mode, split checks
+    // the whole input first
+    template <CharView View>
+    Lexeme munch(View input, uint64_t pos, bool validate);
+
+    template <CharView View>
+    std::vector<Lexeme> split(const View& input);
+
+public:
+    Lexer() = default;
+
+    // patterns are anchored at both ends, so a leading ^ and trailing $ add
+    // nothing. An earlier one wins a tie. A token never matches the empty
+    // string, so the empty pattern is refused
+    Lexer(const std::vector<std::string>& patterns, bool lazy = false,
+          Encoding encoding = Encoding::UTF8, uint32_t flags = 0,
+          uint64_t maxNfaStates = DEFAULT_MAX_NFA_STATES);
+
+    uint64_t size() const {return patterns.size();}
+    const std::string& pattern(uint32_t id) const {return patterns[id];}
+
+    DFA& getDfa() {return dfa;}
+    Encoding getEncoding() const {return encoding;}
+
+    void setUtf8Mode(Utf8Mode mode) {utf8Mode = mode;}
+
+    // the longest token starting at pos, id NO_TOKEN if none does. Under
+    // Utf8Mode::REJECT it throws if the chars it read are malformed
+    Lexeme next(std::string_view input, uint64_t pos);
+
+    // the whole input as tokens, throws where no token matches
+    std::vector<Lexeme> tokenize(std::string_view input);
+    std::vector<Lexeme> tokenize(std::u16string_view input);
+    std::vector<Lexeme> tokenize(std::u32string_view input);
+};
@@ -50,6 +50,8 @@ int main() {
                 start = currTime();
                 evaluator.setRegex(regex, false);
             }
+
+            std::cout << "NFA states: " << evaluator.nfaSize() << '\n';
         }
         else if (response == '4') break;
         else if (response == '5') std::cout << evaluator.getDfa().numStates() << std::endl;
@@ -1,4 +1,6 @@
-#include "dfa.hpp"
+#include "cache.hpp"
+#include "jit.hpp"
+#include "builder.hpp"
 
 #include <chrono>
 
@@ -20,41 +22,148 @@ const char* bools[2] = {"false", "true"};
 
 class Regex {
 private:
-    DFA dfa;
-    NFA nfa;
+    std::shared_ptr<Program> program = std::make_shared<Program>();
+
+    // declared before the DFA it fills, so a move assignment stops it
+    // before replacing the DFA. The destructor stops it first too
+    std::unique_ptr<LazyBuilder> builder;
+
+    // on the heap, so the builder and JitDfa pointing into it survive moves
+    std::unique_ptr<DFA> lazyDfa;
+    bool lazy = false;
+    JitDfa jit;
+    bool useJit = false;
     std::string regex;
+    Encoding encoding = Encoding::UTF8;
+    uint32_t flags = 0;
+    Utf8Mode utf8Mode = Utf8Mode::LENIENT;
+    uint64_t maxNfaStates = DEFAULT_MAX_NFA_STATES;
+    uint64_t buildBudget = 0;
+
+    void compile(bool makeDfa, bool lazy) {
+        ProgramKey key{regex, encoding, flags, makeDfa && !lazy};
+        program = RegexCache::global().get(key, maxNfaStates);
+
+        builder.reset();
+        this->lazy = makeDfa && lazy;
+        lazyDfa = this->lazy ? std::make_unique<DFA>(program->nfa, true) : nullptr;
+        if (this->lazy && buildBudget) builder = std::make_unique<LazyBuilder>(*lazyDfa, buildBudget);
+        buildJit();
+    }
+
+    void buildJit() {
+        bool native = encoding == Encoding::BYTES || encoding == Encoding::UTF8;
+        jit = useJit && native && getDfa().start ? JitDfa(getDfa(), encoding) : JitDfa();
+    }
+
+    // calls fn with the candidate wrapped in the view of the regex encoding
+    template <typename F>
+    bool dispatch(std::string_view candidate, F&& fn) {
+        if (encoding == Encoding::BYTES) return fn(ByteView(candidate));
+        requireEncoding(encoding, Encoding::UTF8);
+        return fn(UTF8View(candidate, utf8Mode));
+    }
 
 public:
-    Regex(const std::string& regex, bool makeDfa = false, bool lazy = false) {
-        this->regex = regex;
-        nfa = NFA(regexToPostfix(std::move(regex)));
-        if (makeDfa) dfa = DFA(nfa, lazy);
+    Regex(const std::string& regex, bool makeDfa = false, bool lazy = false,
+          Encoding encoding = Encoding::UTF8, uint32_t flags = 0)
+        : regex(regex), encoding(encoding), flags(flags) {
+        compile(makeDfa, lazy);
     }
 
     Regex() = default;
 
-    DFA& getDfa() {return dfa;}
-    NFA& getNfa() {return nfa;}
+    ~Regex() {builder.reset();}
+
+    Regex(Regex&&) = default;
+    Regex& operator=(Regex&&) = default;
+
+    DFA& getDfa() {return lazy ? *lazyDfa : program->dfa;}
+    const NFA& getNfa() const {return program->nfa;}
+    Encoding getEncoding() const {return encoding;}
+
+    uint64_t nfaSize() const {return program->nfa.numStates();}
+
+    void setUtf8Mode(Utf8Mode mode) {utf8Mode = mode;}
+
+    // native code for the DFA of byte and utf8 regexes, lazy DFAs are built
+    // in full first, which takes as long as an eager build and up to
+    // JIT_MAX_STATES states before giving up. Falls back to DFA::eval where
+    // it is not supported
+    void setJit(bool enabled) {
+        useJit = enabled;
+        buildJit();
+    }
+
+    bool jitCompiled() const {return jit.compiled();}
+
+    // applies from the next setRegex on, bigger regexes throw instead of compiling
+    void setMaxNfaStates(uint64_t states) {maxNfaStates = states;}
+
+    // applies from the next setRegex on, a lazy DFA is filled ahead of the
+    // matcher on a background thread until it took about budget bytes. 0
+    // turns it off
+    void setBackgroundBuild(uint64_t budget) {buildBudget = budget;}
 
-    void setRegex(const std::string& regex, bool makeDfa = false, bool lazy = false) {
+    void setRegex(const std::string& regex, bool makeDfa = false, bool lazy = false,
+                  Encoding encoding = Encoding::UTF8, uint32_t flags = 0) {
         this->regex = regex;
-        nfa = NFA(regexToPostfix(std::move(regex)));
-        if (makeDfa) dfa = DFA(nfa, lazy);
+        this->encoding = encoding;
+        this->flags = flags;
+        compile(makeDfa, lazy);
     }
 
-    bool eval(const std::string& candidate) {
-        if (dfa.start == nullptr) {
+    bool eval(std::string_view candidate) {
+        if (getDfa().start == nullptr) {
             return evalNfa(candidate);
         }
         return evalDfa(candidate);
     }
 
-    bool evalDfa(const std::string& candidate) {
-        return dfa.eval(candidate);
+    bool eval(std::u16string_view candidate) {
+        if (getDfa().start == nullptr) {
+            return evalNfa(candidate);
+        }
+        return evalDfa(candidate);
+    }
+
+    bool eval(std::u32string_view candidate) {
+        if (getDfa().start == nullptr) {
+            return evalNfa(candidate);
+        }
+        return evalDfa(candidate);
     }
 
-    bool evalNfa(const std::string& candidate) {
-        return simulateNfa(nfa.start, candidate);
+    bool evalDfa(std::string_view candidate) {
+        return dispatch(candidate, [this](const auto& view) {
+            if (jit.compiled()) return jit.eval(view);
+            return getDfa().eval(view);
+        });
     }
-};
 
+    bool evalDfa(std::u16string_view candidate) {
+        requireEncoding(encoding, Encoding::UTF16);
+        return getDfa().eval(UTF16View(candidate, utf8Mode));
+    }
+
+    bool evalDfa(std::u32string_view candidate) {
+        requireEncoding(encoding, Encoding::UTF32);
+        return getDfa().eval(UTF32View(candidate));
+    }
+
+    bool evalNfa(std::string_view candidate) {
+        return dispatch(candidate, [this](const auto& view) {
+            return simulateNfa(program->nfa.start, view);
+        });
+    }
+
+    bool evalNfa(std::u16string_view candidate) {
+        requireEncoding(encoding, Encoding::UTF16);
+        return simulateNfa(program->nfa.start, UTF16View(candidate, utf8Mode));
+    }
+
+    bool evalNfa(std::u32string_view candidate) {
+        requireEncoding(encoding, Encoding::UTF32);
+        return simulateNfa(program->nfa.start, UTF32View(candidate));
+    }
+};
@@ -1,4 +1,5 @@
 #include "nfa.hpp"
+#include "unicode.hpp"
 
 Prec getPrecedence(char_t c) {
     if (static_cast<uint64_t>(c) > 255) return Prec::LITERAL;
@@ -16,7 +17,8 @@ bool canEnd(char_t c) {
     return false;
 }
 
-bool escapedAtEnd(const string& expression) {
+template <CharView View>
+bool escapedAtEnd(const View& expression) {
     if (expression.size() < 2) return false;
 
     uint64_t numSlashes = 0;
@@ -45,10 +47,53 @@ void mergeIntervals(std::vector<ClassInterval>& intervals) {
     intervals.resize(idx + 1);
 }
 
-std::vector<Token> regexToPostfix(string expression) {
+// bounds of the body of a {n}, {n,} or {n,m} quantifier
+ClassInterval parseRepeat(const std::string& body) {
+    auto parseCount = [](std::string_view digits) {
+        if (digits.empty() || digits.size() > 9 ||
+                !std::all_of(digits.begin(), digits.end(),
+                             [](char d) {return d >= '0' && d <= '9';})) {
+            throw std::runtime_error("Malformed repetition");
+        }
+
+        uint64_t count = std::stoull(std::string(digits));
+        if (count > REPEAT_MAX) {
+            throw std::runtime_error("Repetition count too large");
+        }
+        return static_cast<char_t>(count);
+    };
+
+    uint64_t comma = body.find(',');
+    if (comma == std::string::npos) {
+        char_t count = parseCount(body);
+        return {count, count};
+    }
+
+    std::string_view upper = std::string_view(body).substr(comma + 1);
+    char_t min = parseCount(std::string_view(body).substr(0, comma));
+    char_t max = upper.empty() ? REPEAT_INF : parseCount(upper);
+
+    if (min > max) {
+        throw std::runtime_error("Repetition bounds out of order");
+    }
+    return {min, max};
+}
+
+template <CharView View>
+Postfix regexToPostfix(View expression, uint32_t flags) {
+    // inline flags, only at the very start
+    std::string_view inlineIcase = "(?i)";
+    if (expression.size() >= inlineIcase.size() &&
+            std::equal(inlineIcase.begin(), inlineIcase.end(), expression.data())) {
+        flags |= FLAG_ICASE;
+        expression.remove_prefix(inlineIcase.size());
+    }
+
     if (expression.empty()) return {};
 
-    std::vector<Token> res;
+    // every char makes at most one token and one concat
+    Postfix res;
+    res.tokens.reserve(2 * expression.size() + 4);
     std::stack<char_t, std::vector<char_t>> stk;
 
     auto push = [&stk, &res](char_t c) {
@@ -56,7 +101,7 @@ std::vector<Token> regexToPostfix(string expression) {
 
         while (!stk.empty() && getPrecedence(stk.top()) >= prec) {
             char_t op = stk.top();
-            res.push_back({static_cast<Type>(op), op});
+            res.push(static_cast<Type>(op), op);
             stk.pop();
         }
             
@@ -68,7 +113,7 @@ std::vector<Token> regexToPostfix(string expression) {
         if (op == ')') {
             throw std::runtime_error("unmatched (");
         } 
-        res.push_back({static_cast<Type>(op), op});
+        res.push(static_cast<Type>(op), op);
         stk.pop();
     };
 
@@ -85,17 +130,59 @@ std::vector<Token> regexToPostfix(string expression) {
     bool prevCanEnd = false;
     bool inClass = false;
     bool hyphen = false;
+    bool afterClassEscape = false;
     std::vector<ClassInterval> classSet;  
+    std::vector<ClassInterval> folded;
+
+    // body of a {n,m} being read
+    bool repeat = false;
+    std::string repeatBody;
+
+    // \p{...} being read, 'p' or 'P' once its escape is seen
+    char_t property = '\0';
+    bool braced = false;
+    std::string propertyName;
+
+    // bytewise regexes restrict class escapes and case folding to single bytes
+    constexpr bool bytes = std::is_same_v<View, ByteView>;
+    bool icase = flags & (FLAG_ICASE | FLAG_ICASE_ASCII);
+    bool asciiFold = bytes || (flags & FLAG_ICASE_ASCII);
+
+    // a class escape, either part of a [] class or an atom of its own
+    auto addClass = [&](std::span<const ClassInterval> ranges) {
+        if (!inClass && icase) {
+            folded.assign(ranges.begin(), ranges.end());
+            foldIntervals(folded, asciiFold);
+            res.pushClass(Type::CLASS, '\0', folded);
+            return;
+        }
+        if (!inClass) {
+            res.pushClass(Type::CLASS, '\0', ranges);
+            return;
+        }
+        if (hyphen) {
+            throw std::runtime_error("Class escape in a character class range");
+        }
+        classSet.insert(classSet.end(), ranges.begin(), ranges.end());
+        afterClassEscape = true;
+    };
 
     bool leftAnchor = expression[0] == '^';
     bool rightAnchor = expression.back() == '$' && !escapedAtEnd(expression);
 
     if (rightAnchor) expression.pop_back();
 
+    // a lone $ anchors nothing and matches everything
+    if (expression.empty()) {
+        res.push(Type::DOT, '.');
+        res.push(Type::STAR, '*');
+        return res;
+    }
+
     // if there is no ^ anchor, start with .*(
     if (!leftAnchor) {
-        res.push_back({Type::DOT, '.'});
-        res.push_back({Type::STAR, '*'});
+        res.push(Type::DOT, '.');
+        res.push(Type::STAR, '*');
         stk.push(static_cast<char_t>(Type::CONCAT));
         stk.push('(');
     }
@@ -103,6 +190,46 @@ std::vector<Token> regexToPostfix(string expression) {
     bool start = true;
 
     for (char_t c : expression) {
+        // name of a \p{...} property
+        if (property) {
+            if (c == '{' && !braced && propertyName.empty()) {
+                braced = true;
+                continue;
+            }
+
+            // names are ascii, a wider char would be cut to an unrelated byte
+            if (c >= 0x80) {
+                throw std::runtime_error("Non-ascii char in Unicode property name");
+            }
+            if (braced && c != '}') {
+                propertyName += static_cast<char>(c);
+                continue;
+            }
+            if (!braced) propertyName += static_cast<char>(c);
+
+            addClass(propertyRanges(propertyName, property == 'P', bytes));
+            property = '\0';
+            braced = false;
+            propertyName.clear();
+            continue;
+        }
+
+        // counted repetition, applies to the atom before it like the other
+        // quantifiers, so it only has to wait for those already on the stack
+        if (repeat) {
+            if (c != '}') {
+                repeatBody += static_cast<char>(c);
+                continue;
+            }
+
+            while (!stk.empty() && getPrecedence(stk.top()) == Prec::HIGH) pop();
+            ClassInterval bounds = parseRepeat(repeatBody);
+            res.pushClass(Type::REPEAT, c, {&bounds, 1});
+            repeat = false;
+            repeatBody.clear();
+            continue;
+        }
+
         // anchors
         if (c == '^' && start) {start = false; continue;}
         start = false;
@@ -113,9 +240,24 @@ std::vector<Token> regexToPostfix(string expression) {
             continue;
         }
 
-        // inside of a character class
-        if (inClass && getPrecedence(c) != Prec::SQUARE_BRACKETS) {
-            if (escaped || hyphen || c != '-' || classSet.empty()) {
+        // inside of a character class, escaped brackets are plain chars
+        if (inClass && (escaped || getPrecedence(c) != Prec::SQUARE_BRACKETS)) {
+            if (escaped && (c == 'p' || c == 'P')) {
+                escaped = false;
+                property = c;
+                continue;
+            }
+            if (escaped && isClassEscape(c)) {
+                escaped = false;
+                addClass(classEscapeRanges(c, bytes));
+                continue;
+            }
+
+            // a hyphen right after a class escape is a plain '-'
+            bool literalHyphen = afterClassEscape;
+            afterClassEscape = false;
+
+            if (escaped || hyphen || c != '-' || classSet.empty() || literalHyphen) {
                 escaped = false;
                 classSet.push_back({c, c});
 
@@ -141,17 +283,57 @@ std::vector<Token> regexToPostfix(string expression) {
             continue;
         }
 
+        if (c == '{' && !escaped) {
+            if (!prevCanEnd) {
+                throw std::runtime_error("Nothing to repeat");
+            }
+            repeat = true;
+            continue;
+        }
+
+        // operators need an operand before them, so () and a||b are malformed
+        if (!escaped && !prevCanEnd) {
+            if (c == '*' || c == '+' || c == '?') {
+                throw std::runtime_error("Nothing to repeat");
+            }
+            if (c == '|' || c == ')') {
+                throw std::runtime_error("Empty alternative");
+            }
+        }
+
         // concat operator
         if ((canStart(c) || escaped) && prevCanEnd) {
             push(static_cast<char_t>(Type::CONCAT));
         }
         prevCanEnd = canEnd(c) || escaped;
 
+        // class escapes
+        if (escaped && (c == 'p' || c == 'P')) {
+            escaped = false;
+            property = c;
+        }
+        else if (escaped && isClassEscape(c)) {
+            escaped = false;
+            addClass(classEscapeRanges(c, bytes));
+        }
+
         // literals
-        if (escaped || getPrecedence(c) == Prec::LITERAL) {
+        else if (escaped || getPrecedence(c) == Prec::LITERAL) {
+            // an escaped dot is a plain '.'
+            Type type = (c == '.' && !escaped) ? Type::DOT : Type::LITERAL;
             escaped = false;
-            Type type = (c == '.') ? Type::DOT : Type::LITERAL;
-            res.push_back({type, c});
+
+            // case-insensitive literals become the class of their fold orbit
+            folded.clear();
+            if (icase && type == Type::LITERAL) {
+                folded.push_back({c, c});
+                foldIntervals(folded, asciiFold);
+            }
+
+            if (folded.size() > 1 || (!folded.empty() && folded[0].l != folded[0].r)) {
+                res.pushClass(Type::CLASS, '\0', folded);
+            }
+            else res.push(type, c);
         }
 
         // parentheses
@@ -169,14 +351,18 @@ std::vector<Token> regexToPostfix(string expression) {
                 throw std::runtime_error("Unexpected ']' outside of character class");
             }
             
-            if (c == '[') inClass = true;
+            if (c == '[') {
+                inClass = true;
+                afterClassEscape = false;
+            }
             else {
                 if (hyphen) {
                     throw std::runtime_error("Unmatched hyphen in character class");
                 }
                 
                 mergeIntervals(classSet);
-                res.push_back({Type::CLASS, '\0', std::move(classSet)});
+                if (icase) foldIntervals(classSet, asciiFold);
+                res.pushClass(Type::CLASS, '\0', classSet);
                 inClass = false;
                 classSet.clear();
             }
@@ -186,6 +372,23 @@ std::vector<Token> regexToPostfix(string expression) {
         else push(c);
     }
 
+    if (inClass) {
+        throw std::runtime_error("Unterminated character class");
+    }
+    if (escaped) {
+        throw std::runtime_error("Trailing backslash");
+    }
+    if (property) {
+        throw std::runtime_error("Unterminated Unicode property");
+    }
+    if (repeat) {
+        throw std::runtime_error("Unterminated repetition");
+    }
+
+    if (!prevCanEnd && !stk.empty() && stk.top() == '|') {
+        throw std::runtime_error("Empty alternative");
+    }
+
     // if there is no left anchor, match the prepended (
     if (!leftAnchor) rightParen();
 
@@ -198,106 +401,180 @@ std::vector<Token> regexToPostfix(string expression) {
     
     // if there is no right anchor $, append .*
     if (!rightAnchor) {
-        res.push_back({Type::DOT, '.'}); 
-        res.push_back({Type::STAR, '*'});
+        res.push(Type::DOT, '.'); 
+        res.push(Type::STAR, '*');
         if (prevCanEnd) {
-            res.push_back({Type::CONCAT, ' '});
+            res.push(Type::CONCAT, ' ');
         }
     }
 
     return res;
 }
 
+// patch lists
+
+static Fragment makeFragment(State* entry, State** exit) {
+    *exit = nullptr;
+    return {entry, exit, exit};
+}
+
+static void appendExits(Fragment& fragment, const Fragment& other) {
+    *fragment.last = reinterpret_cast<State*>(other.exits);
+    fragment.last = other.last;
+}
+
 void NFA::connect(Fragment& fragment, State* entry) {
-  for (State** outPtr : fragment.exits) {
-        *outPtr = entry;
+    State** exit = fragment.exits;
+
+    while (exit) {
+        State** next = reinterpret_cast<State**>(*exit);
+        *exit = entry;
+        exit = next;
     }
-    fragment.exits.clear();
+
+    fragment.exits = fragment.last = nullptr;
 }
 
 void NFA::concatenate(Fragment& left, Fragment& right) {
-    State* entry = right.entry;
-    connect(left, entry);
-    left.exits = std::move(right.exits);
+    connect(left, right.entry);
+    left.exits = right.exits;
+    left.last = right.last;
 }
 
-State* NFA::postfixToNfa(const std::vector<Token>& tokens) {
-    std::stack<Fragment, std::vector<Fragment>> fragments;
+State* NFA::postfixToNfa(const Postfix& postfix, uint32_t matchId) {
+    const std::vector<Token>& tokens = postfix.tokens;
+
+    // the empty regex, matched by simulateNfa without any states
+    if (tokens.empty()) return nullptr;
+
+    // every token but a concat makes one state, plus the match state, so
+    // states, intervals and class bitmaps come from a single arena chunk
+    uint64_t numNew = 1 + std::count_if(tokens.begin(), tokens.end(), [](const Token& token) {
+        return token.type != Type::CONCAT;
+    });
+    uint64_t numClasses = std::count_if(tokens.begin(), tokens.end(), [](const Token& token) {
+        return token.type == Type::CLASS;
+    });
+    arena.reserve(Arena::bytesFor<State>(numNew) +
+                  Arena::bytesFor<ClassInterval>(postfix.classes.size()) +
+                  Arena::bytesFor<ClassBitmap>(numClasses));
+
+    // scratch reused across compiles, copies of a class (x{3}, ...) refer to
+    // the same intervals and share the state that built them
+    thread_local std::vector<Fragment> fragments;
+    thread_local std::vector<const State*> classStates;
+    fragments.clear();
+    classStates.assign(postfix.classes.size(), nullptr);
+
+    for (const Token& token : tokens) {
+        Type type = token.type;
 
-    for (auto& [type, c, ranges] : tokens) {
         if (type == Type::LITERAL || type == Type::DOT) {
             NodeType nodeT = (type == Type::LITERAL) ?
                               NodeType::LITERAL :
                               NodeType::WILDCARD;
-            State* s = makeState(nodeT, c);
-            fragments.push({s, {s->out}}); 
+            State* s = makeState(nodeT, token.c);
+            fragments.push_back(makeFragment(s, s->out));
         }
         else if (type == Type::CLASS) {
-            State* s = makeState(NodeType::RANGES,
-                                 '\0', std::move(ranges));
-            fragments.push({s, {s->out}});  
+            State* s = makeState(NodeType::RANGES);
+            const State* built = token.count ? classStates[token.first] : nullptr;
+
+            if (built) {
+                s->ranges = built->ranges;
+                s->lowBits = built->lowBits;
+                s->table = built->table;
+            }
+            else {
+                s->ranges = arena.copy(postfix.ranges(token));
+
+                ClassBitmap* lowBits = arena.make<ClassBitmap>();
+                for (auto [l, r] : s->ranges) {
+                    if (l >= LOW_CHARS) break;
+                    setBits(lowBits->data(), l, std::min<char_t>(r, LOW_CHARS - 1));
+                }
+                s->lowBits = lowBits;
+
+                if (s->ranges.size() >= TABLE_MIN_INTERVALS) {
+                    tables.push_back(sharedTable(s->ranges));
+                    s->table = tables.back().get();
+                }
+                if (token.count) classStates[token.first] = s;
+            }
+
+            fragments.push_back(makeFragment(s, s->out));
         }
         else if (type == Type::CONCAT) {
-            Fragment right = std::move(fragments.top());
-            fragments.pop();
-            concatenate(fragments.top(), right);
+            Fragment right = fragments.back();
+            fragments.pop_back();
+            concatenate(fragments.back(), right);
         }
         else if (type == Type::STAR) {
             State* s = makeState(NodeType::SPLIT);
-            Fragment& fragment = fragments.top();
+            Fragment& fragment = fragments.back();
             s->out[0] = fragment.entry;
 
-            while (!fragment.exits.empty()) {
-                *(fragment.exits.back()) = s;
-                fragment.exits.pop_back();
-            }
-
-            fragment.exits.push_back(&s->out[1]);
-            fragment.entry = s;
+            connect(fragment, s);
+            fragment = makeFragment(s, &s->out[1]);
         }
         else if (type == Type::UNION) {
             State* s = makeState(NodeType::SPLIT);
 
-            Fragment a = std::move(fragments.top());
-            fragments.pop();
-            Fragment b = std::move(fragments.top());
-            fragments.pop();
+            Fragment a = fragments.back();
+            fragments.pop_back();
+            Fragment b = fragments.back();
 
             s->out[0] = a.entry;
             s->out[1] = b.entry;
 
-            std::vector<State**> exits = std::move(a.exits);
-            exits.insert(exits.end(), b.exits.begin(),
-                    b.exits.end());
-
-            fragments.push({s, std::move(exits)});
+            appendExits(a, b);
+            fragments.back() = {s, a.exits, a.last};
         }
         else if (type == Type::QUESTION) {
             State* s = makeState(NodeType::SPLIT);
-            Fragment& fragment = fragments.top();
+            Fragment& fragment = fragments.back();
             s->out[0] = fragment.entry;
 
-            fragment.exits.push_back(&s->out[1]);
+            appendExits(fragment, makeFragment(s, &s->out[1]));
             fragment.entry = s;
         }
         else if (type == Type::PLUS) {
             State* s = makeState(NodeType::SPLIT);
-            Fragment& fragment = fragments.top();
+            Fragment& fragment = fragments.back();
 
             connect(fragment, s);
             s->out[0] = fragment.entry;
-            fragment.exits.push_back(&s->out[1]);
+            fragment.exits = fragment.last = &s->out[1];
         }
-    } 
+        else if (type == Type::REPEAT) {
+            throw std::runtime_error("Counted repetition must be expanded by simplifyPostfix");
+        }
+    }
 
-    State* match = makeState(NodeType::MATCH);
-    connect(fragments.top(), match);
+    State* match = makeState(NodeType::MATCH, matchId);
+    connect(fragments.back(), match);
 
-    start = fragments.top().entry;
-    return start;
+    return fragments.back().entry;
 }
 
-bool searchRange(std::vector<ClassInterval>& ranges, char_t c) {
+State* NFA::link(State* entry, State* next) {
+    State* s = makeState(NodeType::SPLIT);
+    s->out[0] = entry;
+    s->out[1] = next ? next : s;
+    return s;
+}
+
+State* NFA::prependAny(State* entry) {
+    State* loop = makeState(NodeType::SPLIT);
+    State* any = makeState(NodeType::WILDCARD);
+
+    any->out[0] = loop;
+    loop->out[0] = any;
+    loop->out[1] = entry;
+    return loop;
+}
+
+bool searchRange(std::span<const ClassInterval> ranges, char_t c) {
    if (!ranges.size()) return false;
 
     auto res = std::lower_bound(
@@ -317,8 +594,20 @@ bool searchRange(std::vector<ClassInterval>& ranges, char_t c) {
     return res->r >= c;
 }
 
-bool simulateNfa(State* start, const string& candidate) {
+bool inClass(const State* state, char_t c) {
+    if (c < LOW_CHARS) {
+        return ((*state->lowBits)[c >> 6] >> (c & 63)) & 1;
+    }
+    if (state->table && c <= MAX_CODE_POINT) {
+        return state->table->contains(c);
+    }
+    return searchRange(state->ranges, c);
+}
+
+template <CharView View>
+bool simulateNfa(State* start, const View& candidate) {
     if (!start) return candidate.empty();
+    if (!candidate.acceptable()) return false;
 
     std::unordered_set<State*> states = {start};
     std::unordered_set<State*> newStates;
@@ -370,7 +659,7 @@ bool simulateNfa(State* start, const string& candidate) {
             if ((state->type != NodeType::MATCH && state->c == c)
                     || state->type == NodeType::WILDCARD ||
                     (state->type == NodeType::RANGES &&
-                    searchRange(state->ranges, c))) {
+                    inClass(state, c))) {
                 newStates.insert(state->out[0]);
             }
         }
@@ -390,39 +679,23 @@ bool simulateNfa(State* start, const string& candidate) {
     return false;
 }
 
+template bool escapedAtEnd(const ByteView&);
+
+template Postfix regexToPostfix(ByteView, uint32_t);
+template Postfix regexToPostfix(UTF8View, uint32_t);
+template Postfix regexToPostfix(UTF16View, uint32_t);
+template Postfix regexToPostfix(UTF32View, uint32_t);
+
+template bool simulateNfa(State*, const ByteView&);
+template bool simulateNfa(State*, const UTF8View&);
+template bool simulateNfa(State*, const UTF16View&);
+template bool simulateNfa(State*, const UTF32View&);
+
 std::vector<char32_t> convertToUtf32(const std::string& input) {
-    std::vector<char32_t> res;
-    uint8_t remainingBytes = 0;
-    char32_t curr = 0;
-    
-    for (char c : input) {
-        if (!remainingBytes) {
-            if (!(c & 0x80)) {
-                res.push_back(c);
-                continue;
-            }
-            else if (!(c & 0x20)) {
-                remainingBytes = 2;
-                c &= 0x1F;;
-            }
-            else if (!(c & 0x10)) {
-                remainingBytes = 3;
-                c &= 0x0F;
-            }
-            else {
-                remainingBytes = 4;
-                c &= 0x07;
-            }
-        }
-        
-        curr = (curr << 6) | (c & 0x3F);
+    const char* begin = input.data();
+    const char* end = begin + input.size();
 
-        if (!--remainingBytes) {
-            res.push_back(curr);
-            curr = 0;
-        }
-    }
-    
+    std::vector<char32_t> res(utf32Length(begin, end));
+    transcodeUtf8ToUtf32(begin, end, res.data());
     return res;
 }
-
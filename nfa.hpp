@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
 #include <string>
 #include <array>
 #include <stack>
@@ -8,13 +9,32 @@
 #include <memory>
 #include <optional>
 #include <unordered_set>
+#include <limits>
+#include <span>
+
+#include "arena.hpp"
+#include "views.hpp"
 
 // constants
 
 using char_t = char32_t;
+constexpr char_t MAX_CHAR = std::numeric_limits<char_t>::max();
 //using string = std::string;
 
-constexpr int NFA_ARENA_SIZE = 256;
+// chars below this are tested against a class bitmap (ascii + latin-1)
+constexpr char_t LOW_CHARS = 256;
+
+// compile flags
+constexpr uint32_t FLAG_ICASE = 1 << 0;        // simple Unicode case folding
+constexpr uint32_t FLAG_ICASE_ASCII = 1 << 1;  // case folding of a-z only
+
+// set on the id of a MATCH state that also matches every longer candidate,
+// pattern sets use it instead of a trailing .*
+constexpr char_t MATCH_STICKY = 1u << 31;
+
+// counted repetition, {n,} is stored with REPEAT_INF as its upper bound
+constexpr char_t REPEAT_MAX = 1000;
+constexpr char_t REPEAT_INF = MAX_CHAR;
 
 // data structures
 
@@ -26,7 +46,8 @@ enum class Type : char_t {
     UNION = '|',
     DOT = '.',
     QUESTION = '?',
-    PLUS = '+'
+    PLUS = '+',
+    REPEAT = '{'
 };
 
 enum class Prec : char_t {
@@ -45,10 +66,32 @@ struct ClassInterval {
     auto operator<=>(const ClassInterval&) const = default;
 };
 
+// class intervals live out of line in Postfix::classes, a token refers to
+// them by offset. A REPEAT keeps its bounds there as the single interval [min, max]
 struct Token {
     Type type;
     char_t c;
-    std::vector<ClassInterval> ranges;
+    uint32_t first = 0;
+    uint32_t count = 0;
+};
+
+struct Postfix {
+    std::vector<Token> tokens;
+    std::vector<ClassInterval> classes;
+
+    std::span<const ClassInterval> ranges(const Token& token) const {
+        return {classes.data() + token.first, token.count};
+    }
+
+    void push(Type type, char_t c) {
+        tokens.push_back({type, c});
+    }
+
+    void pushClass(Type type, char_t c, std::span<const ClassInterval> ranges) {
+        uint32_t first = classes.size();
+        classes.insert(classes.end(), ranges.begin(), ranges.end());
+        tokens.push_back({type, c, first, static_cast<uint32_t>(ranges.size())});
+    }
 };
 
 enum class NodeType : char_t {
@@ -59,130 +102,102 @@ enum class NodeType : char_t {
     WILDCARD
 };
 
+using ClassBitmap = std::array<uint64_t, LOW_CHARS / 64>;
+
+// sets bits [l, r] a word at a time
+inline void setBits(uint64_t* words, char_t l, char_t r) {
+    for (char_t word = l >> 6; word <= r >> 6; word++) {
+        char_t from = std::max<char_t>(l, word << 6) & 63;
+        char_t to = std::min<char_t>(r, (word << 6) + 63) & 63;
+        words[word] |= (~0ULL >> (63 - to)) & (~0ULL << from);
+    }
+}
+
+struct CodePointTable;
+
 struct State {
     State* out[2] = {nullptr, nullptr};
     NodeType type;
     char_t c;
-    std::vector<ClassInterval> ranges;
+
+    // sorted and merged, stored in the NFA arena
+    std::span<const ClassInterval> ranges;
+
+    // membership of chars below LOW_CHARS, a single bit test. Only RANGES
+    // states have one, stored in the NFA arena
+    const ClassBitmap* lowBits = nullptr;
+
+    // O(1) membership for big classes, owned by the NFA
+    const CodePointTable* table = nullptr;
 
     State() = default;
 
     State(NodeType type, char_t c = 0) : type(type), c(c) {}
 };
 
+// the dangling out pointers of a fragment form a list threaded through the
+// pointers themselves, each holds the address of the next until it is patched
 struct Fragment {
     State* entry;
-    std::vector<State**> exits;
+    State** exits;
+    State** last;
 };
 
-struct UTF8View : public std::string_view {
-    using std::string_view::string_view;
-
-    UTF8View(const std::string& s) : std::string_view(s) {}
-
-    UTF8View(std::string&&) = delete;
-
-    struct Iterator {
-        const char* ptr;
-
-        inline char8_t getNumBytes(char8_t c) const {
-            if (!(c & 0x80)) return 1;
-            if (!(c & 0x20)) return 2;
-            if (!(c & 0x10)) return 3;
-            if ((c & 0xF0) == 0xF0) return 4;
-            // invalid utf8, fallback to 1byte
-            return 1;
-        }
-
-        inline char_t getChar() const {
-            uint8_t numBytes = getNumBytes(*ptr);
-
-            // one byte
-            char_t c = *ptr;
-            if (numBytes == 1) return c;
-
-            // two bytes
-            char_t c2 = ptr[1] & 0x3F;
-            if (numBytes == 2) return (c & 0x1F) << 6 | c2;
-            
-            // three bytes
-            char_t c3 = ptr[2] & 0x3F;
-            if (numBytes == 3) return (c & 0x0F) << 12 | c2 << 6 | c3;
-            
-            // four bytes
-            char_t c4 = ptr[3] & 0x3F;
-            return (c & 0x07) << 18 | c2 << 12 | c3 << 6 | c4;
-        }
-
-        char_t operator*() const {
-            return getChar();
-        }
-
-        Iterator& operator++() {
-            ptr += getNumBytes(*ptr);
-            return *this;
-        }
-
-        bool operator==(const Iterator& other) const {
-            return ptr == other.ptr;
-        }
-
-        bool operator!=(const Iterator& other) const {
-            return ptr != other.ptr;
-        }     
-    };
-
-    Iterator begin() const {
-        return Iterator{data()};
-    }
-
-    Iterator end() const {
-        return Iterator{data() + size()};
-    }
-
-    void pop_back() {
-        remove_suffix(1);
-    }
-};
-
-// IMPORTANT
-using string = UTF8View;
-
 class NFA {
 private:
-    int arenaIdx = NFA_ARENA_SIZE;
-    std::vector<std::unique_ptr<State[]>> stateArenas;
+    Arena arena;
+    uint64_t stateCount = 0;
+    std::vector<std::shared_ptr<const CodePointTable>> tables;
 
 public:
     State* start = nullptr;
 
-    State* makeState(NodeType type, char_t c = 0,
-                     std::optional<std::vector<ClassInterval>> ranges = std::nullopt) {
-
-        if (arenaIdx >= NFA_ARENA_SIZE) {
-            auto uPtr = std::make_unique<State[]>(NFA_ARENA_SIZE);
-            stateArenas.push_back(std::move(uPtr));
-            arenaIdx = 0;
-        }
-        
-        stateArenas.back()[arenaIdx] = State(type, c);
-        if (ranges) {
-            stateArenas.back()[arenaIdx].ranges = std::move(ranges.value());
-        }
-        return &stateArenas.back()[arenaIdx++];
+    // the .* loop a pattern set shares, every DFA state holds its closure
+    State* base = nullptr;
+
+    State* makeState(NodeType type, char_t c = 0) {
+        stateCount++;
+        return arena.make<State>(type, c);
     }
 
     void connect(Fragment& fragment, State* entry);
     void concatenate(Fragment& left, Fragment& right);
-    State* postfixToNfa(const std::vector<Token>& tokens);
+    State* postfixToNfa(const Postfix& postfix, uint32_t matchId = 0);
+
+    // the states of one pattern of a set, its MATCH state holds the id in c.
+    // The empty pattern is a bare MATCH state
+    State* addPattern(const Postfix& postfix, uint32_t id) {
+        State* entry = postfixToNfa(postfix, id);
+        return entry ? entry : makeState(NodeType::MATCH, id);
+    }
+
+    // a SPLIT reaching entry and then the rest of a chain. The last link of a
+    // chain loops to itself, so an unlinked entry is just pointed back too
+    State* link(State* entry, State* next);
+
+    static void unlink(State* link) {
+        link->out[0] = link;
+    }
+
+    // a .* loop in front of entry
+    State* prependAny(State* entry);
+
+    uint64_t numStates() const {
+        return stateCount;
+    }
+
+    // heap bytes owned by this NFA, shared tables are not counted
+    uint64_t memoryUsage() const {
+        return sizeof(NFA) + arena.bytes();
+    }
 
     NFA() = default;
 
-    NFA(const std::vector<Token>& tokens) {
-        start = postfixToNfa(tokens);
+    NFA(const Postfix& postfix) {
+        start = postfixToNfa(postfix);
     }
 };
-    
+
 constexpr std::array<Prec, 256> getPrecedenceArray() {
     std::array<Prec, 256> precedence = {};
     
@@ -205,9 +220,14 @@ constexpr auto PRECEDENCE = getPrecedenceArray();
 bool canStart(char_t);
 bool canEnd(char_t);
 Prec getPrecedence(char_t);
-bool escapedAtEnd(const string&); 
+template <CharView View>
+bool escapedAtEnd(const View&);
 void mergeIntervals(std::vector<ClassInterval>&);
-std::vector<Token> regexToPostfix(string);
-bool simulateNfa(State*, const string&);
+ClassInterval parseRepeat(const std::string&);
+template <CharView View>
+Postfix regexToPostfix(View, uint32_t flags = 0);
+template <CharView View>
+bool simulateNfa(State*, const View&);
+bool inClass(const State*, char_t);
 std::vector<char32_t> convertToUtf32(const std::string&);
 
@@ -0,0 +1,86 @@
+#include "pool.hpp"
+
+WorkStealingPool::WorkStealingPool(unsigned numThreads) {
+    numThreads = std::max(numThreads, 1u);
+
+    for (unsigned i = 0; i < numThreads; i++) queues.push_back(std::make_unique<Queue>());
+    for (unsigned i = 0; i < numThreads; i++) threads.emplace_back(&WorkStealingPool::loop, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (std::thread& thread : threads) thread.join();
+}
+
+bool WorkStealingPool::take(unsigned self, uint64_t& chunk) {
+    {
+        Queue& own = *queues[self];
+        std::lock_guard lock(own.mutex);
+
+        if (!own.chunks.empty()) {
+            chunk = own.chunks.front();
+            own.chunks.pop_front();
+            return true;
+        }
+    }
+
+    // the back of a victim's run is the work it would reach last
+    for (unsigned i = 1; i < queues.size(); i++) {
+        Queue& victim = *queues[(self + i) % queues.size()];
+        std::lock_guard lock(victim.mutex);
+
+        if (!victim.chunks.empty()) {
+            chunk = victim.chunks.back();
+            victim.chunks.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void WorkStealingPool::loop(unsigned self) {
+    uint64_t seen = 0;
+
+    while (true) {
+        {
+            std::unique_lock lock(mutex);
+            wake.wait(lock, [&]() {return stopping || generation != seen;});
+            if (stopping) return;
+            seen = generation;
+        }
+
+        uint64_t chunk;
+        while (take(self, chunk)) job(chunk, self);
+
+        std::lock_guard lock(mutex);
+        if (--busy == 0) done.notify_one();
+    }
+}
+
+void WorkStealingPool::run(uint64_t numChunks, std::function<void(uint64_t, unsigned)> fn) {
+    if (numChunks == 0) return;
+
+    uint64_t numQueues = queues.size();
+    for (uint64_t i = 0; i < numQueues; i++) {
+        Queue& queue = *queues[i];
+        std::lock_guard lock(queue.mutex);
+
+        for (uint64_t c = numChunks * i / numQueues; c < numChunks * (i + 1) / numQueues; c++) {
+            queue.chunks.push_back(c);
+        }
+    }
+
+    std::unique_lock lock(mutex);
+    job = std::move(fn);
+    busy = threads.size();
+    generation++;
+    wake.notify_all();
+
+    done.wait(lock, [this]() {return busy == 0;});
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// constants
+
+// 0 threads means one per core
+inline unsigned defaultThreads(unsigned numThreads) {
+    return numThreads ? numThreads : std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+// data structures
+
+// fixed workers running one job at a time. The chunks of a job are dealt
+// out in contiguous runs, a worker takes from the front of its own deque
+// and steals from the back of the others once it runs dry
+class WorkStealingPool {
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<uint64_t> chunks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    std::function<void(uint64_t, unsigned)> job;
+    uint64_t generation = 0;
+    unsigned busy = 0;
+    bool stopping = false;
+
+    bool take(unsigned self, uint64_t& chunk);
+    void loop(unsigned self);
+
+public:
+    explicit WorkStealingPool(unsigned numThreads);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned size() const {return threads.size();}
+
+    // calls fn(chunk, worker) for every chunk below numChunks and returns
+    // once all of them are done. One job runs at a time
+    void run(uint64_t numChunks, std::function<void(uint64_t, unsigned)> fn);
+};
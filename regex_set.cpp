@@ -0,0 +1,185 @@
+#include "regex_set.hpp"
+
+#include <chrono>
+
+RegexSet::Member RegexSet::compile(uint32_t id) {
+    std::string_view inlineIcase = "(?i)";
+    std::string_view pattern = patterns[id];
+
+    // the inline flag has to stay in front of the anchor
+    bool icase = pattern.starts_with(inlineIcase);
+    if (icase) pattern.remove_prefix(inlineIcase.size());
+    uint64_t size = pattern.size();
+
+    // unanchored patterns are compiled anchored and share one leading
+    // .*. Without a $ the match is sticky instead of followed by .*, so
+    // a state does not have to remember which patterns matched so far
+    bool shared = size && pattern[0] != '^';
+
+    // a trailing backslash is left for the parser to reject
+    bool sticky = size && ((pattern.back() != '$' && pattern.back() != '\\') ||
+                           escapedAtEnd(ByteView(pattern)));
+
+    std::string source(icase ? inlineIcase : "");
+    if (shared) source += '^';
+    source += pattern;
+    if (sticky) source += '$';
+
+    try {
+        Postfix postfix = compilePostfix(source, encoding, flags, maxNfaStates);
+
+        Member member;
+        member.entry = nfa.addPattern(postfix, sticky ? id | MATCH_STICKY : id);
+        member.shared = shared;
+        return member;
+    }
+    catch (const std::exception& e) {
+        throw std::runtime_error("Pattern " + std::to_string(id) + ": " + e.what());
+    }
+}
+
+bool RegexSet::attach(Member& member) {
+    if (!member.shared) {
+        member.link = nfa.start = nfa.link(member.entry, nfa.start);
+        return false;
+    }
+
+    if (nfa.base) {
+        member.link = nfa.base->out[1] = nfa.link(member.entry, nfa.base->out[1]);
+        return false;
+    }
+
+    member.link = nfa.link(member.entry, nullptr);
+    nfa.base = nfa.prependAny(member.link);
+    nfa.start = nfa.link(nfa.base, nfa.start);
+    return true;
+}
+
+RegexSet::RegexSet(const std::vector<std::string>& patterns, bool lazy, Encoding encoding,
+                   uint32_t flags, uint64_t maxNfaStates)
+    : patterns(patterns), lazy(lazy), encoding(encoding), flags(flags), maxNfaStates(maxNfaStates) {
+    for (uint32_t id = 0; id < patterns.size(); id++) {
+        members.push_back(compile(id));
+        attach(members.back());
+    }
+
+    dfa = DFA(nfa, lazy);
+}
+
+void RegexSet::compact() {
+    nfa = NFA();
+
+    for (uint32_t id = 0; id < patterns.size(); id++) {
+        if (members[id].removed) continue;
+        members[id] = compile(id);
+        attach(members[id]);
+    }
+
+    dfa = DFA(nfa, lazy);
+}
+
+SetUpdate RegexSet::add(const std::string& pattern) {
+    auto begin = std::chrono::steady_clock::now();
+    uint32_t id = patterns.size();
+
+    patterns.push_back(pattern);
+    try {
+        members.push_back(compile(id));
+    }
+    catch (...) {
+        patterns.pop_back();
+        throw;
+    }
+
+    SetUpdate update = {id, false, 0, 0, 0};
+    Member& member = members.back();
+
+    if (attach(member) || !lazy || !dfa.start) {
+        dfa = DFA(nfa, lazy);
+        update.rebuilt = true;
+    }
+    else if (member.shared) {
+        update.statesPatched = dfa.extendBase(member.entry);
+    }
+    else dfa.restart(nfa.start);
+
+    update.statesKept = dfa.numFilled();
+    update.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return update;
+}
+
+SetUpdate RegexSet::remove(uint32_t id) {
+    if (!contains(id)) {
+        throw std::invalid_argument("No pattern with id " + std::to_string(id));
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    SetUpdate update = {id, false, 0, 0, 0};
+
+    Member& member = members[id];
+    NFA::unlink(member.link);
+    member.removed = true;
+    numRemoved++;
+
+    if (numRemoved > numLive()) {
+        compact();
+        update.rebuilt = true;
+    }
+    else if (!lazy) {
+        dfa = DFA(nfa, lazy);
+        update.rebuilt = true;
+    }
+    else {
+        // the pattern's states only lead to each other
+        HashSet<State*> dead;
+        std::vector<State*> stk = {member.entry};
+        dead.insert(member.entry);
+
+        while (!stk.empty()) {
+            State* state = stk.back();
+            stk.pop_back();
+
+            for (State* out : state->out) {
+                if (out && dead.insert(out).second) stk.push_back(out);
+            }
+        }
+
+        update.statesPatched = dfa.dropStates(dead);
+    }
+
+    update.statesKept = dfa.numFilled();
+    update.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return update;
+}
+
+template <CharView View>
+const std::vector<uint32_t>& RegexSet::walk(const View& candidate) {
+    matched.clear();
+    seenSticky.resize((patterns.size() + 63) / 64);
+    DfaState* last = dfa.walk(candidate, matched, seenSticky);
+
+    // only the sticky ids are marked
+    for (uint32_t id : matched) seenSticky[id >> 6] &= ~(1ULL << (id & 63));
+    if (last) matched.insert(matched.end(), last->matchIds.begin(), last->matchIds.end());
+
+    std::sort(matched.begin(), matched.end());
+    matched.erase(std::unique(matched.begin(), matched.end()), matched.end());
+    return matched;
+}
+
+const std::vector<uint32_t>& RegexSet::eval(std::string_view candidate) {
+    if (encoding == Encoding::BYTES) return walk(ByteView(candidate));
+
+    requireEncoding(encoding, Encoding::UTF8);
+    return walk(UTF8View(candidate, utf8Mode));
+}
+
+const std::vector<uint32_t>& RegexSet::eval(std::u16string_view candidate) {
+    requireEncoding(encoding, Encoding::UTF16);
+    return walk(UTF16View(candidate, utf8Mode));
+}
+
+const std::vector<uint32_t>& RegexSet::eval(std::u32string_view candidate) {
+    requireEncoding(encoding, Encoding::UTF32);
+    return walk(UTF32View(candidate));
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "cache.hpp"
+
+// data structures
+
+// the cost of one add or remove. Without a rebuild the filled states
+// survive and only the patched ones had their neighbors rewritten
+struct SetUpdate {
+    uint32_t id;
+    bool rebuilt;
+    uint64_t statesKept;
+    uint64_t statesPatched;
+    double seconds;
+};
+
+// many patterns matched in a single pass. Their NFAs hang off one start
+// state and each ends in a MATCH state holding its id, so the DFA states a
+// candidate passes list every pattern the candidate matched
+class RegexSet {
+private:
+    // where a pattern sits in the NFA, shared ones hang off the base
+    struct Member {
+        State* entry = nullptr;
+        State* link = nullptr;
+        bool shared = false;
+        bool removed = false;
+    };
+
+    std::vector<std::string> patterns;
+    std::vector<Member> members;
+    uint64_t numRemoved = 0;
+
+    NFA nfa;
+    DFA dfa;
+    bool lazy = true;
+    Encoding encoding = Encoding::UTF8;
+    uint32_t flags = 0;
+    uint64_t maxNfaStates = DEFAULT_MAX_NFA_STATES;
+    Utf8Mode utf8Mode = Utf8Mode::LENIENT;
+
+    Member compile(uint32_t id);
+
+    // links the member into the NFA, true if the base had to be created
+    bool attach(Member& member);
+
+    // a fresh NFA of the live patterns once the removed ones outnumber them
+    void compact();
+
+    // ids found by the last eval
+    std::vector<uint32_t> matched;
+
+    // a bit per id for the sticky walk, clear between evals
+    std::vector<uint64_t> seenSticky;
+
+    template <CharView View>
+    const std::vector<uint32_t>& walk(const View& candidate);
+
+public:
+    RegexSet() = default;
+
+    // lazy by default, an eager DFA over thousands of patterns rarely fits
+    RegexSet(const std::vector<std::string>& patterns, bool lazy = true,
+             Encoding encoding = Encoding::UTF8, uint32_t flags = 0,
+             uint64_t maxNfaStates = DEFAULT_MAX_NFA_STATES);
+
+    // ids are never reused, removed patterns keep theirs
+    uint64_t size() const {return patterns.size();}
+    uint64_t numLive() const {return patterns.size() - numRemoved;}
+    bool contains(uint32_t id) const {return id < members.size() && !members[id].removed;}
+    const std::string& pattern(uint32_t id) const {return patterns[id];}
+
+    // a lazy set keeps the states filled so far and patches those the
+    // update affects, an eager one is rebuilt
+    SetUpdate add(const std::string& pattern);
+    SetUpdate remove(uint32_t id);
+
+    DFA& getDfa() {return dfa;}
+    const NFA& getNfa() const {return nfa;}
+    Encoding getEncoding() const {return encoding;}
+
+    void setUtf8Mode(Utf8Mode mode) {utf8Mode = mode;}
+
+    // ids of the patterns the candidate matches, ascending. The vector is
+    // reused by the next eval
+    const std::vector<uint32_t>& eval(std::string_view candidate);
+    const std::vector<uint32_t>& eval(std::u16string_view candidate);
+    const std::vector<uint32_t>& eval(std::u32string_view candidate);
+
+    bool evalAny(std::string_view candidate) {
+        return !eval(candidate).empty();
+    }
+};
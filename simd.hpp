@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstring>
+#include <cstdint>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// byte search
+
+// returns the first byte in [ptr, end) equal to any of the n (<= 3) needles,
+// or end if there is none
+inline const char* findAnyByte(const char* ptr, const char* end,
+                               const char* needles, int n) {
+    if (n == 0) return end;
+
+    if (n == 1) {
+        const void* res = std::memchr(ptr, needles[0], end - ptr);
+        return res ? static_cast<const char*>(res) : end;
+    }
+
+    char a = needles[0];
+    char b = needles[1];
+    char c = (n == 3) ? needles[2] : b;
+
+#ifdef __SSE2__
+    __m128i va = _mm_set1_epi8(a);
+    __m128i vb = _mm_set1_epi8(b);
+    __m128i vc = _mm_set1_epi8(c);
+
+    while (end - ptr >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+        __m128i eq = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)),
+            _mm_cmpeq_epi8(chunk, vc)
+        );
+
+        int mask = _mm_movemask_epi8(eq);
+        if (mask) return ptr + __builtin_ctz(mask);
+        ptr += 16;
+    }
+#endif
+
+    for (; ptr < end; ++ptr) {
+        if (*ptr == a || *ptr == b || *ptr == c) return ptr;
+    }
+
+    return end;
+}
+
+// findAnyByte for wider code units, the needles are ascii
+template <typename Unit>
+inline const Unit* findAnyUnit(const Unit* ptr, const Unit* end,
+                               const char* needles, int n) {
+    if (n == 0) return end;
+
+    Unit a = needles[0];
+    Unit b = n > 1 ? needles[1] : a;
+    Unit c = n > 2 ? needles[2] : b;
+
+    for (; ptr < end; ++ptr) {
+        if (*ptr == a || *ptr == b || *ptr == c) return ptr;
+    }
+
+    return end;
+}
@@ -0,0 +1,171 @@
+#include "speculative.hpp"
+
+SpeculativeMatcher::SpeculativeMatcher(const std::string& pattern, Encoding encoding,
+                                       uint32_t flags, unsigned numThreads, uint64_t chunkSize)
+    : encoding(encoding), fixedChunk(chunkSize), pool(defaultThreads(numThreads)) {
+    if (encoding != Encoding::BYTES && encoding != Encoding::UTF8) {
+        throw std::invalid_argument("Speculative matching reads byte or utf8 input");
+    }
+
+    program = RegexCache::global().get({pattern, encoding, flags, true});
+
+    // small DFAs are listed to be run from every state
+    DfaState* start = program->dfa.start;
+    if (!start || static_cast<uint64_t>(program->dfa.numStates()) > SPECULATE_ALL_STATES) return;
+
+    HashSet<DfaState*> seen = {start};
+    allStates.push_back(start);
+
+    for (uint64_t i = 0; i < allStates.size(); i++) {
+        for (auto& [l, r, neighbor] : allStates[i]->neighbors) {
+            if (seen.insert(neighbor).second) allStates.push_back(neighbor);
+        }
+    }
+}
+
+uint64_t SpeculativeMatcher::align(std::string_view input, uint64_t pos) const {
+    // sequences only ever extend over continuation bytes, in every mode
+    if (encoding == Encoding::UTF8) {
+        while (pos < input.size() && isContinuation(input[pos])) pos++;
+    }
+    return std::min<uint64_t>(pos, input.size());
+}
+
+template <CharView View>
+void SpeculativeMatcher::guess(const View& input, Chunk& piece) {
+    DFA& dfa = program->dfa;
+
+    if (piece.begin == 0) {
+        piece.from = {dfa.start};
+        return;
+    }
+    if (!allStates.empty()) {
+        piece.from = allStates;
+        return;
+    }
+
+    piece.from.clear();
+
+    for (uint64_t lookback : LOOKBACK_BYTES) {
+        uint64_t begin = align(input, piece.begin > lookback ? piece.begin - lookback : 0);
+
+        View window = input;
+        window.remove_suffix(input.size() - piece.begin);
+        window.remove_prefix(begin);
+
+        DfaState* state = dfa.walk(window);
+        if (state && std::find(piece.from.begin(), piece.from.end(), state) == piece.from.end()) {
+            piece.from.push_back(state);
+        }
+
+        // from the very start the guess is exact
+        if (begin == 0) break;
+    }
+}
+
+template <CharView View>
+void SpeculativeMatcher::runChunk(const View& input, Chunk& piece) {
+    guess(input, piece);
+
+    View text = input;
+    text.remove_suffix(input.size() - piece.end);
+    text.remove_prefix(piece.begin);
+
+    // lanes run in lockstep until they merge, lane[i] is the one of from[i]
+    std::vector<DfaState*> live = piece.from;
+    std::vector<uint64_t> lane(live.size());
+    for (uint64_t i = 0; i < lane.size(); i++) lane[i] = i;
+
+    auto it = text.begin();
+    auto end = text.end();
+    uint64_t steps = 0;
+
+    while (live.size() > 1 && it != end) {
+        char32_t c = *it;
+        for (DfaState*& state : live) {
+            if (state) state = DFA::findNeighbor(state, c);
+        }
+        ++it;
+
+        if (++steps % MERGE_EVERY) continue;
+
+        std::vector<DfaState*> merged = live;
+        std::sort(merged.begin(), merged.end());
+        merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+        if (merged.size() == live.size()) continue;
+
+        for (uint64_t& idx : lane) {
+            idx = std::lower_bound(merged.begin(), merged.end(), live[idx]) - merged.begin();
+        }
+        live = std::move(merged);
+    }
+
+    // one lane left, the rest is a plain walk
+    if (live.size() == 1 && live[0] && it != end) {
+        View rest = text;
+        rest.remove_prefix(it.ptr - text.data());
+        live[0] = program->dfa.walkFrom(live[0], rest);
+    }
+
+    piece.to.resize(lane.size());
+    for (uint64_t i = 0; i < lane.size(); i++) piece.to[i] = live[lane[i]];
+}
+
+template <CharView View>
+bool SpeculativeMatcher::evalView(const View& input) {
+    DFA& dfa = program->dfa;
+    if (dfa.start == nullptr) return input.empty();
+
+    chunk = fixedChunk ? fixedChunk : std::max(input.size() / (2 * pool.size()), MIN_PARALLEL_BYTES);
+    stats = {};
+
+    if (input.size() < MIN_PARALLEL_BYTES || pool.size() == 1) {
+        stats.chunks = 1;
+        return dfa.eval(input);
+    }
+
+    chunks.clear();
+    for (uint64_t begin = 0; begin < input.size();) {
+        uint64_t end = align(input, begin + chunk);
+        chunks.push_back({begin, end, {}, {}});
+        begin = end;
+    }
+
+    pool.run(chunks.size(), [&](uint64_t c, unsigned) {runChunk(input, chunks[c]);});
+
+    // chain the maps, a state a chunk did not guess means running it again
+    DfaState* curr = dfa.start;
+    stats.chunks = chunks.size();
+
+    for (Chunk& piece : chunks) {
+        stats.guesses += piece.from.size();
+
+        auto known = std::find(piece.from.begin(), piece.from.end(), curr);
+        if (known != piece.from.end()) {
+            curr = piece.to[known - piece.from.begin()];
+        }
+        else {
+            View text = input;
+            text.remove_suffix(input.size() - piece.end);
+            text.remove_prefix(piece.begin);
+
+            curr = dfa.walkFrom(curr, text);
+            stats.misses++;
+        }
+
+        if (curr == nullptr) return false;
+    }
+
+    return curr->isMatch;
+}
+
+bool SpeculativeMatcher::eval(std::string_view input) {
+    if (encoding == Encoding::BYTES) return evalView(ByteView(input));
+
+    // once validated, rejecting input reads like any other
+    if (utf8Mode == Utf8Mode::REJECT) {
+        if (!validateUtf8(input.data(), input.data() + input.size())) return false;
+        return evalView(UTF8View(input, Utf8Mode::LENIENT));
+    }
+    return evalView(UTF8View(input, utf8Mode));
+}
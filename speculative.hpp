@@ -0,0 +1,81 @@
+#pragma once
+
+#include "batch.hpp"
+
+// constants
+
+// inputs shorter than this are matched on the calling thread
+constexpr uint64_t MIN_PARALLEL_BYTES = 1 << 16;
+
+// a DFA with at most this many states is run from all of them, so a chunk
+// can never miss
+constexpr uint64_t SPECULATE_ALL_STATES = 16;
+
+// otherwise a chunk guesses the states reached from the start over these
+// many bytes before it, most DFAs forget older input by then
+constexpr uint64_t LOOKBACK_BYTES[] = {32, 256, 4096};
+
+// lanes that reached the same state are merged every this many chars
+constexpr uint64_t MERGE_EVERY = 32;
+
+// data structures
+
+struct SpeculationStats {
+    uint64_t chunks = 0;
+    uint64_t guesses = 0;
+
+    // chunks entered in a state they did not guess, run again after
+    uint64_t misses = 0;
+};
+
+// one large byte or utf8 input matched by several threads. The input is cut
+// into chunks on char boundaries, and each chunk runs the shared eager DFA
+// from a few guessed states at once, mapping each guess to the state it
+// ends in. The maps are then chained from the start state, and a chunk
+// entered in a state it did not guess is run again from that state
+class SpeculativeMatcher {
+private:
+    struct Chunk {
+        uint64_t begin, end;
+        std::vector<DfaState*> from;
+        std::vector<DfaState*> to;
+    };
+
+    std::shared_ptr<Program> program;
+    std::vector<DfaState*> allStates;
+    Encoding encoding = Encoding::UTF8;
+    Utf8Mode utf8Mode = Utf8Mode::LENIENT;
+
+    // 0 picks one per input, the last one used is kept in chunk
+    uint64_t fixedChunk = 0;
+    uint64_t chunk = 0;
+
+    std::vector<Chunk> chunks;
+    SpeculationStats stats;
+    WorkStealingPool pool;
+
+    // a byte where a char starts, at or after pos
+    uint64_t align(std::string_view input, uint64_t pos) const;
+
+    template <CharView View>
+    void guess(const View& input, Chunk& piece);
+
+    template <CharView View>
+    void runChunk(const View& input, Chunk& piece);
+
+    template <CharView View>
+    bool evalView(const View& input);
+
+public:
+    // 0 threads uses every core
+    SpeculativeMatcher(const std::string& pattern, Encoding encoding = Encoding::UTF8,
+                       uint32_t flags = 0, unsigned numThreads = 0, uint64_t chunkSize = 0);
+
+    unsigned numThreads() const {return pool.size();}
+    uint64_t chunkSize() const {return chunk;}
+    SpeculationStats lastStats() const {return stats;}
+
+    void setUtf8Mode(Utf8Mode mode) {utf8Mode = mode;}
+
+    bool eval(std::string_view input);
+};
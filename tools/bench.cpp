@@ -0,0 +1,780 @@
+#include "dfa.hpp"
+#include "ast.hpp"
+#include "batch.hpp"
+#include "builder.hpp"
+#include "cache.hpp"
+#include "column.hpp"
+#include "ct_regex.hpp"
+#include "jit.hpp"
+#include "lexer.hpp"
+#include "regex_set.hpp"
+#include "speculative.hpp"
+
+#include <bit>
+#include <chrono>
+#include <map>
+#include <random>
+#include <thread>
+
+// helpers
+
+auto currTime = []() { return std::chrono::high_resolution_clock::now(); };
+
+// best of reps runs, in seconds
+template <typename F>
+double timeBest(F&& fn, int reps = 5) {
+    double best = std::numeric_limits<double>::max();
+
+    for (int i = 0; i < reps; i++) {
+        auto start = currTime();
+        fn();
+        std::chrono::duration<double> diff = currTime() - start;
+        best = std::min(best, diff.count());
+    }
+
+    return best;
+}
+
+// ascii text where roughly one in every nonAsciiEvery chars is multibyte
+std::string makeText(uint64_t size, uint64_t nonAsciiEvery) {
+    const char* multibyte[] = {"é", "ß", "€", "日", "🚀"};
+    std::mt19937 rng(42);
+    std::string text;
+    text.reserve(size + 4);
+
+    while (text.size() < size) {
+        if (nonAsciiEvery && rng() % nonAsciiEvery == 0) {
+            text += multibyte[rng() % 5];
+        }
+        else text += static_cast<char>('a' + rng() % 26);
+    }
+
+    return text;
+}
+
+void report(const char* name, uint64_t bytes, double seconds) {
+    std::cout << "  " << name << ": " << bytes / seconds / 1e9 << " GB/s\n";
+}
+
+// benchmarks
+
+void benchSpeculative() {
+    constexpr uint64_t SIZE = 64 << 20;
+    std::string text = makeText(SIZE, 20);
+    unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+
+    std::cout << "speculative matching of " << SIZE / (1 << 20) << " MiB of text, "
+              << cores << " cores\n";
+
+    for (const char* pattern : {"(error|warn)z", "^([a-m][n-z]|[n-z][a-m]|.)*$", "q[a-z]{8}x"}) {
+        auto program = compileProgram({pattern, Encoding::UTF8, 0, true});
+        bool expected = false;
+
+        std::cout << "  " << pattern << " (" << program->dfa.numStates() << " states)\n";
+        report("DFA::eval", SIZE, timeBest([&]() {expected = program->dfa.eval(UTF8View(text));}, 3));
+
+        for (unsigned threads = 2; threads <= std::max(cores, 2u); threads *= 2) {
+            SpeculativeMatcher matcher(pattern, Encoding::UTF8, 0, threads);
+            bool actual = false;
+
+            double seconds = timeBest([&]() {actual = matcher.eval(text);}, 3);
+            SpeculationStats stats = matcher.lastStats();
+
+            std::string name = "SpeculativeMatcher, " + std::to_string(threads) + " threads";
+            std::cout << "  " << name << ": " << SIZE / seconds / 1e9 << " GB/s, " << stats.chunks
+                      << " chunks, " << stats.misses << " missed"
+                      << (actual == expected ? "" : " MISMATCH") << "\n";
+        }
+    }
+}
+
+void benchTranscode() {
+    // cache resident input, repeated to get a stable measurement
+    constexpr uint64_t SIZE = 1 << 20;
+    constexpr int REPEAT = 64;
+
+    for (uint64_t every : {0, 100, 20, 2}) {
+        std::string text = makeText(SIZE, every);
+        const char* begin = text.data();
+        const char* end = begin + text.size();
+
+        std::cout << "utf8 -> utf32, 1 in " << every << " chars multibyte\n";
+
+        std::vector<char32_t> buffer(utf32Length(begin, end));
+        volatile uint64_t sink = 0;
+
+        uint64_t bytes = text.size() * REPEAT;
+
+        report("utf32Length", bytes, timeBest([&]() {
+            for (int i = 0; i < REPEAT; i++) sink = sink + utf32Length(begin, end);
+        }));
+        report("transcodeUtf8ToUtf32", bytes, timeBest([&]() {
+            for (int i = 0; i < REPEAT; i++) {
+                sink = sink + transcodeUtf8ToUtf32(begin, end, buffer.data());
+            }
+        }));
+        report("UTF8View push_back", bytes, timeBest([&]() {
+            for (int i = 0; i < REPEAT; i++) {
+                std::vector<char32_t> res;
+                for (char_t c : UTF8View(text)) res.push_back(c);
+                sink = sink + res.size();
+            }
+        }));
+    }
+}
+
+// rule-like patterns: words, classes, alternations and quantifiers
+std::vector<std::string> makePatterns(uint64_t count) {
+    const char* pieces[] = {
+        "error", "warn(ing)?", "[0-9]+", "\\d{1,3}", "[a-z_][a-z0-9_]*", "(get|post|put)",
+        "/api/v[12]/", "\\s+", "user[s]?", "(foo|bar|baz)+", "\\w+@\\w+", "[A-F0-9]{8}",
+    };
+    std::mt19937 rng(7);
+    std::vector<std::string> patterns;
+
+    for (uint64_t i = 0; i < count; i++) {
+        std::string pattern = rng() % 2 ? "^" : "";
+        for (int j = 1 + rng() % 4; j > 0; j--) pattern += pieces[rng() % 12];
+        patterns.push_back(std::move(pattern));
+    }
+
+    return patterns;
+}
+
+// lowercase words of 3 to 8 letters
+std::vector<std::string> makeWords(uint64_t count, std::mt19937& rng) {
+    std::vector<std::string> words;
+
+    for (uint64_t i = 0; i < count; i++) {
+        std::string word;
+        for (int len = 3 + rng() % 6; len > 0; len--) word += 'a' + rng() % 26;
+        words.push_back(std::move(word));
+    }
+
+    return words;
+}
+
+// log rules: a keyword or two, then maybe a field
+std::vector<std::string> makeRules(uint64_t count, const std::vector<std::string>& words) {
+    const char* fields[] = {"", "", " \\d+", "=[a-z0-9_]+", " (ok|failed)", ".*timeout", " [0-9]{1,3}ms"};
+    std::mt19937 rng(5);
+    std::vector<std::string> rules;
+
+    for (uint64_t i = 0; i < count; i++) {
+        std::string rule = words[rng() % words.size()];
+        if (rng() % 2) rule += " " + words[rng() % words.size()];
+        rules.push_back(rule + fields[rng() % 7]);
+    }
+
+    return rules;
+}
+
+// log lines over the same words: a few hundred messages, each logged many
+// times with different numbers
+std::vector<std::string> makeLogLines(uint64_t count, const std::vector<std::string>& words) {
+    const char* fields[] = {"ok", "failed", "timeout", "user=bob", "[INFO]"};
+    std::mt19937 rng(3);
+    std::vector<std::string> messages;
+
+    for (int i = 0; i < 300; i++) {
+        std::string message;
+        for (int j = 6 + rng() % 10; j > 0; j--) {
+            message += rng() % 4 ? words[rng() % words.size()] : fields[rng() % 5];
+            message += ' ';
+        }
+        messages.push_back(std::move(message));
+    }
+
+    std::vector<std::string> lines;
+    for (uint64_t i = 0; i < count; i++) {
+        lines.push_back(messages[rng() % messages.size()] + std::to_string(rng() % 100000) + "ms");
+    }
+
+    return lines;
+}
+
+void benchCompile() {
+    constexpr uint64_t COUNT = 20000;
+    std::vector<std::string> patterns = makePatterns(COUNT);
+    volatile uint64_t sink = 0;
+
+    std::cout << "compile " << COUNT << " patterns to NFAs\n";
+
+    // kept alive like a rule set loaded at startup
+    double seconds = timeBest([&]() {
+        std::vector<NFA> nfas;
+        nfas.reserve(COUNT);
+
+        for (const std::string& pattern : patterns) {
+            nfas.emplace_back(simplifyPostfix(regexToPostfix(UTF8View(pattern))));
+            sink = sink + nfas.back().numStates();
+        }
+    });
+
+    std::cout << "  " << COUNT / seconds << " patterns/s\n";
+}
+
+void benchEagerBuild() {
+    unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    std::cout << "eager DFA construction, " << cores << " cores\n";
+
+    for (const char* pattern : {"^[ab]*a[ab]{14}$", "^[\\p{L}0-9]*[a-f][\\p{L}0-9]{10}$"}) {
+        NFA nfa(simplifyPostfix(regexToPostfix(UTF8View(std::string_view(pattern)))));
+        DFA dfa;
+
+        double sequential = timeBest([&]() {dfa = DFA(nfa);}, 1);
+        std::cout << "  " << pattern << " (" << dfa.numStates() << " states)\n"
+                  << "    1 thread: " << sequential << "s\n";
+
+        for (unsigned threads = 2; threads <= std::max(cores, 2u); threads *= 2) {
+            double seconds = timeBest([&]() {dfa = DFA(nfa, false, threads);}, 1);
+            std::cout << "    " << threads << " threads: " << seconds << "s, "
+                      << sequential / seconds << "x\n";
+        }
+    }
+}
+
+void benchKeywords() {
+    constexpr uint64_t COUNT = 1000;
+    std::mt19937 rng(11);
+    std::string pattern = "(";
+
+    for (uint64_t i = 0; i < COUNT; i++) {
+        if (i) pattern += '|';
+        for (int len = 4 + rng() % 7; len > 0; len--) pattern += 'a' + rng() % 8;
+    }
+    pattern += ")";
+
+    std::cout << "alternation of " << COUNT << " keywords\n";
+
+    auto run = [&](const char* name, const Postfix& postfix) {
+        NFA nfa(postfix);
+        DFA dfa;
+        double build = timeBest([&]() {dfa = DFA(nfa);}, 1);
+
+        std::cout << "  " << name << ": " << nfa.numStates() << " NFA states, "
+                  << dfa.numStates() << " DFA states, eager build " << build << "s\n";
+    };
+
+    run("parallel chains", regexToPostfix(UTF8View(pattern)));
+    run("trie", simplifyPostfix(regexToPostfix(UTF8View(pattern))));
+}
+
+void benchBatch() {
+    constexpr uint64_t LINES = 1000000;
+    std::mt19937 rng(45);
+    std::vector<std::string> words = makeWords(1000, rng);
+    std::vector<std::string> lines = makeLogLines(LINES, words);
+    std::vector<std::string_view> views(lines.begin(), lines.end());
+    const std::string pattern = "(failed|timeout).*[0-9]{4}ms$";
+
+    std::cout << "batch matching " << LINES << " log lines, "
+              << std::thread::hardware_concurrency() << " cores\n";
+
+    NFA nfa(simplifyPostfix(regexToPostfix(UTF8View(pattern))));
+    DFA dfa(nfa, true);
+    uint64_t expected = 0;
+
+    double sequential = timeBest([&]() {
+        expected = 0;
+        for (std::string_view line : views) expected += dfa.eval(UTF8View(line));
+    }, 3);
+    std::cout << "  DFA::eval loop: " << LINES / sequential / 1e6 << "M lines/s\n";
+
+    unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned threads = 1; threads <= cores; threads *= 2) {
+        BatchMatcher batch(pattern, true, Encoding::UTF8, 0, threads);
+        uint64_t actual = 0;
+
+        double seconds = timeBest([&]() {
+            const std::vector<uint64_t>& bits = batch.eval(views);
+            actual = 0;
+            for (uint64_t word : bits) actual += std::popcount(word);
+        }, 3);
+
+        std::cout << "  BatchMatcher, " << threads << " threads, chunks of " << batch.chunkSize()
+                  << ": " << LINES / seconds / 1e6 << "M lines/s"
+                  << (actual == expected ? "" : " MISMATCH") << "\n";
+    }
+}
+
+void benchColumn() {
+    constexpr uint64_t ROWS = 1000000;
+    std::mt19937 rng(48);
+    std::vector<std::string> words = makeWords(1000, rng);
+    std::vector<std::string> lines = makeLogLines(ROWS, words);
+    const std::string pattern = "(failed|timeout).*[0-9]{4}ms$";
+
+    // one data buffer and int32 offsets, as in an arrow string column
+    std::string data;
+    std::vector<int32_t> offsets = {0};
+    for (const std::string& line : lines) {
+        data += line;
+        offsets.push_back(data.size());
+    }
+
+    std::cout << "column matching " << ROWS << " log lines, " << data.size() / (1 << 20)
+              << " MiB\n";
+
+    auto program = compileProgram({pattern, Encoding::UTF8, 0, true});
+    uint64_t expected = 0;
+
+    double copied = timeBest([&]() {
+        expected = 0;
+        for (uint64_t i = 0; i < ROWS; i++) {
+            std::string row(data.data() + offsets[i], offsets[i + 1] - offsets[i]);
+            expected += program->dfa.eval(UTF8View(row));
+        }
+    }, 3);
+    std::cout << "  std::string per row + DFA::eval: " << ROWS / copied / 1e6 << "M rows/s\n";
+
+    double viewed = timeBest([&]() {
+        for (uint64_t i = 0; i < ROWS; i++) {
+            program->dfa.eval(UTF8View(std::string_view(data).substr(offsets[i],
+                                                                     offsets[i + 1] - offsets[i])));
+        }
+    }, 3);
+    std::cout << "  string_view per row + DFA::eval: " << ROWS / viewed / 1e6 << "M rows/s\n";
+
+    ColumnMatcher column(pattern);
+    uint64_t actual = 0;
+
+    double filtered = timeBest([&]() {
+        actual = 0;
+        for (uint64_t word : column.filter(data, offsets)) actual += std::popcount(word);
+    }, 3);
+    std::cout << "  ColumnMatcher::filter: " << ROWS / filtered / 1e6 << "M rows/s"
+              << (actual == expected ? "" : " MISMATCH") << "\n";
+
+    double selected = timeBest([&]() {actual = column.select(data, offsets).size();}, 3);
+    std::cout << "  ColumnMatcher::select: " << ROWS / selected / 1e6 << "M rows/s"
+              << (actual == expected ? "" : " MISMATCH") << "\n";
+}
+
+void benchLockstep() {
+    constexpr uint64_t COUNT = 200000;
+    std::mt19937 rng(46);
+
+    std::cout << "lockstep matching of " << COUNT << " short candidates\n";
+
+    // the last k chars decide the state, so random input lands on random
+    // states of a DFA with 2^(k + 1) of them
+    for (int k : {10, 14, 16}) {
+        std::string pattern = "^[ab]*a[ab]{" + std::to_string(k) + "}$";
+        NFA nfa(simplifyPostfix(regexToPostfix(ByteView(pattern))));
+        DFA dfa(nfa);
+
+        std::vector<std::string> candidates(COUNT);
+        for (std::string& candidate : candidates) {
+            for (int len = 24 + rng() % 40; len > 0; len--) candidate += "ab"[rng() % 2];
+        }
+
+        uint64_t chars = 0;
+        for (const std::string& candidate : candidates) chars += candidate.size();
+
+        std::cout << "  " << pattern << " (" << dfa.numStates() << " states, "
+                  << dfa.memoryUsage() / 1024 << " KiB)\n";
+
+        uint64_t expected = 0;
+        double sequential = timeBest([&]() {
+            expected = 0;
+            for (const std::string& candidate : candidates) expected += dfa.eval(ByteView(candidate));
+        }, 3);
+        std::cout << "    DFA::eval loop: " << chars / sequential / 1e6 << "M chars/s\n";
+
+        std::vector<uint64_t> bits((COUNT + 63) / 64);
+        auto lockstep = [&]<int Lanes>() {
+            uint64_t actual = 0;
+            double seconds = timeBest([&]() {
+                std::fill(bits.begin(), bits.end(), 0);
+                dfa.evalLockstep<Lanes>(COUNT, [&](uint64_t i) {return ByteView(candidates[i]);},
+                                        bits.data());
+                actual = 0;
+                for (uint64_t word : bits) actual += std::popcount(word);
+            }, 3);
+
+            std::cout << "    evalLockstep<" << Lanes << ">: " << chars / seconds / 1e6 << "M chars/s"
+                      << (actual == expected ? "" : " MISMATCH") << "\n";
+        };
+
+        lockstep.operator()<1>();
+        lockstep.operator()<4>();
+        lockstep.operator()<8>();
+        lockstep.operator()<16>();
+    }
+}
+
+void benchBuilder() {
+    constexpr uint64_t COUNT = 20000;
+    constexpr uint64_t BUDGET = 64 << 20;
+    std::mt19937 rng(49);
+
+    std::cout << "lazy DFA, first pass over " << COUNT << " candidates\n";
+
+    for (int k : {8, 12}) {
+        std::string pattern = "^[ab]*a[ab]{" + std::to_string(k) + "}$";
+        NFA nfa(simplifyPostfix(regexToPostfix(UTF8View(pattern))));
+
+        std::vector<std::string> candidates(COUNT);
+        for (std::string& candidate : candidates) {
+            for (int i = 0; i < 64; i++) candidate += "ab"[rng() % 2];
+        }
+
+        auto pass = [&](DFA& dfa) {
+            auto start = currTime();
+            for (const std::string& candidate : candidates) dfa.eval(UTF8View(candidate));
+            std::chrono::duration<double> diff = currTime() - start;
+            return diff.count() * 1e3;
+        };
+
+        std::cout << "  " << pattern << "\n";
+
+        DFA cold(nfa, true);
+        double coldMs = pass(cold);
+        std::cout << "    cold: " << coldMs << " ms, hot: " << pass(cold) << " ms\n";
+
+        // the builder gets a head start, as between compiling and the first query
+        for (int headStart : {0, 10, 100}) {
+            DFA dfa(nfa, true);
+            LazyBuilder builder(dfa, BUDGET);
+            std::this_thread::sleep_for(std::chrono::milliseconds(headStart));
+
+            double ms = pass(dfa);
+            BuildStats stats = builder.getStats();
+            std::cout << "    builder, " << headStart << " ms head start: " << ms << " ms, "
+                      << stats.filled << " built, " << stats.misses << " missed\n";
+        }
+    }
+}
+
+void benchCache() {
+    constexpr uint64_t COUNT = 1000;
+    constexpr int LOOKUPS = 200;
+    std::vector<std::string> patterns = makePatterns(COUNT);
+    RegexCache cache;
+
+    std::cout << "cache of " << COUNT << " hot patterns\n";
+
+    double cold = timeBest([&]() {
+        cache.clear();
+        for (const std::string& pattern : patterns) cache.get({pattern, Encoding::UTF8, 0, false});
+    }, 1);
+
+    std::cout << "  miss: " << cold / COUNT * 1e6 << " us/pattern\n";
+
+    for (unsigned threads : {1u, 4u, 16u}) {
+        double hot = timeBest([&]() {
+            std::vector<std::thread> workers;
+
+            for (unsigned t = 0; t < threads; t++) {
+                workers.emplace_back([&, t]() {
+                    for (int i = 0; i < LOOKUPS; i++) {
+                        for (uint64_t j = 0; j < COUNT; j++) {
+                            cache.get({patterns[(j + t * 97) % COUNT], Encoding::UTF8, 0, false});
+                        }
+                    }
+                });
+            }
+
+            for (std::thread& worker : workers) worker.join();
+        });
+
+        std::cout << "  hit, " << threads << " threads: "
+                  << threads * COUNT * LOOKUPS / hot / 1e6 << "M lookups/s\n";
+    }
+
+    CacheStats stats = cache.stats();
+    std::cout << "  " << stats.entries << " entries, " << stats.bytes / 1024 << " KiB\n";
+}
+
+// matches lines with the runtime eager DFA and the CtRegex of the same pattern
+template <typename Ct>
+void compareCtRegex(const std::vector<std::string>& lines) {
+    constexpr int REPEAT = 20;
+    std::string_view pattern = Ct::pattern();
+    volatile uint64_t sink = 0;
+
+    NFA nfa;
+    DFA dfa;
+    double build = timeBest([&]() {
+        nfa = NFA(simplifyPostfix(regexToPostfix(ByteView(pattern))));
+        dfa = DFA(nfa);
+    });
+
+    std::cout << "  " << pattern << " (" << Ct::numStates() << " states, runtime build "
+              << build * 1e6 << " us)\n";
+
+    double runtime = timeBest([&]() {
+        for (int i = 0; i < REPEAT; i++) {
+            for (const std::string& line : lines) sink = sink + dfa.eval(ByteView(line));
+        }
+    });
+    double compiled = timeBest([&]() {
+        for (int i = 0; i < REPEAT; i++) {
+            for (const std::string& line : lines) sink = sink + Ct::eval(line);
+        }
+    });
+
+    std::cout << "    DFA::eval: " << REPEAT * lines.size() / runtime / 1e6 << "M lines/s\n";
+    std::cout << "    CtRegex::eval: " << REPEAT * lines.size() / compiled / 1e6 << "M lines/s\n";
+}
+
+void benchCtRegex() {
+    constexpr uint64_t COUNT = 100000;
+    std::mt19937 rng(39);
+    std::vector<std::string> lines;
+
+    // dotted quads and key=value pairs, a few of them malformed
+    for (uint64_t i = 0; i < COUNT; i++) {
+        std::string line;
+        if (i % 2) {
+            for (int j = 0; j < 4; j++) {
+                if (j) line += '.';
+                line += std::to_string(rng() % (rng() % 16 ? 256 : 10000));
+            }
+        }
+        else {
+            for (int len = 3 + rng() % 12; len > 0; len--) line += 'a' + rng() % 26;
+            line += rng() % 16 ? '=' : '-';
+            line += std::to_string(rng());
+        }
+        lines.push_back(std::move(line));
+    }
+
+    std::cout << "compile time regexes on " << COUNT << " short lines\n";
+    compareCtRegex<CtRegex<R"(^\d{1,3}(\.\d{1,3}){3}$)">>(lines);
+    compareCtRegex<CtRegex<"^[a-z_][a-z0-9_]*=[0-9]+$">>(lines);
+    compareCtRegex<CtRegex<"(?i)[aeiou]{3}">>(lines);
+}
+
+void benchRegexSet() {
+    constexpr uint64_t COUNT = 2000;
+    constexpr uint64_t LINES = 5000;
+    std::mt19937 rng(9);
+    std::vector<std::string> words = makeWords(1000, rng);
+    std::vector<std::string> patterns = makeRules(COUNT, words);
+    std::vector<std::string> lines = makeLogLines(LINES, words);
+
+    std::cout << COUNT << " patterns against " << LINES << " log lines\n";
+
+    std::vector<NFA> nfas;
+    std::vector<DFA> dfas;
+    nfas.reserve(COUNT);
+    dfas.reserve(COUNT);
+
+    for (const std::string& pattern : patterns) {
+        nfas.emplace_back(simplifyPostfix(regexToPostfix(UTF8View(pattern))));
+        dfas.emplace_back(nfas.back(), true);
+    }
+
+    RegexSet set;
+    double build = timeBest([&]() {set = RegexSet(patterns);}, 1);
+    uint64_t expected = 0, actual = 0;
+
+    auto runSeparate = [&]() {
+        expected = 0;
+        for (const std::string& line : lines) {
+            for (DFA& dfa : dfas) expected += dfa.eval(UTF8View(line));
+        }
+    };
+
+    auto runSet = [&]() {
+        actual = 0;
+        for (const std::string& line : lines) actual += set.eval(line).size();
+    };
+
+    // lazy DFAs fill up on the first pass
+    double separateCold = timeBest(runSeparate, 1);
+    double separate = timeBest(runSeparate, 3);
+    double singleCold = timeBest(runSet, 1);
+    double single = timeBest(runSet, 3);
+
+    std::cout << "  set build: " << build * 1e3 << " ms, " << set.getDfa().numStates()
+              << " DFA states after matching, " << set.getDfa().memoryUsage() / (1 << 20) << " MiB\n";
+    std::cout << "  " << COUNT << " DFAs: " << LINES / separateCold << " lines/s cold, "
+              << LINES / separate << " lines/s warm\n";
+    std::cout << "  RegexSet: " << LINES / singleCold << " lines/s cold, "
+              << LINES / single << " lines/s warm\n";
+    std::cout << "  matches: " << expected << " / " << actual
+              << (expected == actual ? "" : " MISMATCH") << "\n";
+}
+
+void benchLexer() {
+    constexpr uint64_t SIZE = 1 << 20;
+    std::mt19937 rng(44);
+
+    // keywords come before the identifiers they also match
+    std::vector<std::string> tokens = {
+        "if", "else", "while", "for", "return", "let", "fn", "true", "false", "match", "in",
+        "break", "continue", "struct", "enum", "impl", "pub", "use", "mod", "const", "static",
+        "loop", "as", "where", "type", "self", "async", "await", "move", "ref", "mut",
+        "[a-zA-Z_][a-zA-Z0-9_]*", "[0-9]+", "[0-9]+\\.[0-9]+", "\"[ !#-~]*\"", "//[ -~]*",
+        "[ \t\n]+", "==|!=|<=|>=|&&|\\|\\|", "[-+*/%<>=!]", "[(){};,.]", "\\[|\\]",
+    };
+
+    const char* samples[] = {
+        "if", "else", "while", "for", "return", "let", "fn", "true", "false", "match", "struct", "loop", "await", "count",
+        "iffy", "x_1", "forward", "42", "3.14", "\"say hi\"", "// note\n", " ", "\n  ",
+        "==", "&&", "+", "=", "(", ")", "[", "]", "{", "}", ";", ",",
+    };
+
+    std::string source;
+    while (source.size() < SIZE) {
+        source += samples[rng() % std::size(samples)];
+        source += ' ';
+    }
+
+    std::cout << "tokenizing " << SIZE / 1024 << " KiB with " << tokens.size() << " token patterns\n";
+
+    Lexer lexer(tokens);
+    uint64_t count = 0;
+    double single = timeBest([&]() {count = lexer.tokenize(source).size();});
+
+    // the same tokens tried one at a time at every position
+    std::vector<NFA> nfas;
+    std::vector<DFA> dfas;
+    nfas.reserve(tokens.size());
+    dfas.reserve(tokens.size());
+
+    for (const std::string& token : tokens) {
+        std::string anchored = "^" + token + "$";
+        nfas.emplace_back(simplifyPostfix(regexToPostfix(UTF8View(anchored))));
+        dfas.emplace_back(nfas.back());
+    }
+
+    uint64_t expected = 0;
+    double separate = timeBest([&]() {
+        expected = 0;
+        for (uint64_t pos = 0; pos < source.size(); expected++) {
+            uint64_t best = pos;
+
+            for (DFA& dfa : dfas) {
+                DfaState* curr = dfa.start;
+                for (uint64_t i = pos; i < source.size() && curr; i++) {
+                    curr = DFA::findNeighbor(curr, static_cast<uint8_t>(source[i]));
+                    if (curr && curr->isMatch && i + 1 > best) best = i + 1;
+                }
+            }
+
+            if (best == pos) break;
+            pos = best;
+        }
+    }, 1);
+
+    report("Lexer::tokenize", SIZE, single);
+    report("one DFA per token", SIZE, separate);
+    std::cout << "  tokens: " << expected << " / " << count << (expected == count ? "" : " MISMATCH") << "\n";
+}
+
+void benchSetUpdate() {
+    constexpr uint64_t COUNT = 2000;
+    constexpr uint64_t LINES = 5000;
+    constexpr uint64_t UPDATES = 50;
+    std::mt19937 rng(43);
+    std::vector<std::string> words = makeWords(1000, rng);
+    std::vector<std::string> patterns = makeRules(COUNT + UPDATES, words);
+    std::vector<std::string> lines = makeLogLines(LINES, words);
+
+    std::vector<std::string> initial(patterns.begin(), patterns.begin() + COUNT);
+    RegexSet set(initial);
+    uint64_t sink = 0;
+
+    auto runSet = [&]() {
+        for (const std::string& line : lines) sink += set.eval(line).size();
+    };
+    runSet();
+
+    std::cout << UPDATES << " adds and removes on a warm set of " << COUNT << " patterns, "
+              << set.getDfa().numFilled() << " states filled\n";
+
+    // each update is followed by a pass over the lines, the states it
+    // invalidated are filled again there
+    double updates = 0, passes = 0;
+    uint64_t patched = 0, kept = 0, rebuilds = 0;
+
+    auto apply = [&](const SetUpdate& update) {
+        updates += update.seconds;
+        patched += update.statesPatched;
+        kept += update.statesKept;
+        rebuilds += update.rebuilt;
+        passes += timeBest(runSet, 1);
+    };
+
+    for (uint64_t i = 0; i < UPDATES; i++) apply(set.add(patterns[COUNT + i]));
+    for (uint64_t i = 0; i < UPDATES; i++) apply(set.remove(i * 7));
+
+    // the same updates by building the set again
+    double rebuild = timeBest([&]() {set = RegexSet(initial);}, 1);
+    double cold = timeBest(runSet, 1);
+
+    std::cout << "  incremental: " << updates / (2 * UPDATES) * 1e3 << " ms per update, "
+              << patched / (2 * UPDATES) << " states patched, " << kept / (2 * UPDATES)
+              << " kept, " << rebuilds << " rebuilds\n";
+    std::cout << "    next pass: " << passes / (2 * UPDATES) * 1e3 << " ms\n";
+    std::cout << "  rebuild: " << rebuild * 1e3 << " ms, next pass: " << cold * 1e3 << " ms\n";
+}
+
+void benchJit() {
+    constexpr uint64_t SIZE = 1 << 20;
+    constexpr int REPEAT = 16;
+
+    std::cout << "jit compiled DFAs on " << SIZE / 1024 << " KiB of text\n";
+    if (!JIT_SUPPORTED) std::cout << "  (no JIT on this platform, both run the interpreter)\n";
+
+    for (uint64_t every : {0, 20}) {
+        std::string text = makeText(SIZE, every);
+        volatile uint64_t sink = 0;
+
+        std::cout << " 1 in " << every << " chars multibyte\n";
+
+        for (const char* pattern : {"[0-9]{4}-[0-9]{2}", "^([a-m][n-z]|[n-z][a-m]|.)*$", "(error|warn)z"}) {
+            NFA nfa(simplifyPostfix(regexToPostfix(UTF8View(std::string_view(pattern)))));
+            DFA dfa(nfa);
+            JitDfa jit(dfa, Encoding::UTF8);
+
+            std::cout << "  " << pattern << " (" << jit.numStates() << " states)\n";
+            report("DFA::eval", text.size() * REPEAT, timeBest([&]() {
+                for (int i = 0; i < REPEAT; i++) sink = sink + dfa.eval(UTF8View(text));
+            }));
+            report("JitDfa::eval", text.size() * REPEAT, timeBest([&]() {
+                for (int i = 0; i < REPEAT; i++) sink = sink + jit.eval(UTF8View(text));
+            }));
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    std::map<std::string, void (*)()> benches = {
+        {"batch", benchBatch},
+        {"builder", benchBuilder},
+        {"cache", benchCache},
+        {"column", benchColumn},
+        {"compile", benchCompile},
+        {"ctregex", benchCtRegex},
+        {"eagerbuild", benchEagerBuild},
+        {"jit", benchJit},
+        {"keywords", benchKeywords},
+        {"lexer", benchLexer},
+        {"lockstep", benchLockstep},
+        {"regexset", benchRegexSet},
+        {"setupdate", benchSetUpdate},
+        {"speculative", benchSpeculative},
+        {"transcode", benchTranscode},
+    };
+
+    if (argc < 2) {
+        for (auto& [name, bench] : benches) bench();
+        return 0;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        auto it = benches.find(argv[i]);
+        if (it == benches.end()) {
+            std::cout << "unknown benchmark " << argv[i] << '\n';
+            return 1;
+        }
+        it->second();
+    }
+
+    return 0;
+}
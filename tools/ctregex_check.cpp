@@ -0,0 +1,241 @@
+// checks the constexpr parser in ct_regex.hpp against regexToPostfix and
+// DFA::eval, on fixed CtRegex samples and on random patterns run through
+// ctCompile at runtime. Exits with 1 on the first disagreement
+
+#include "ct_regex.hpp"
+#include "dfa.hpp"
+#include "ast.hpp"
+
+#include <random>
+
+// data structures
+
+struct CtSample {
+    std::string_view pattern;
+    uint32_t flags;
+    bool (*eval)(std::string_view);
+};
+
+// constants
+
+constexpr uint64_t NUM_RANDOM_PATTERNS = 3000;
+constexpr uint64_t CHECKS_PER_SAMPLE = 20000;
+constexpr uint64_t CHECKS_PER_PATTERN = 300;
+constexpr uint64_t MAX_CANDIDATE_PIECES = 16;
+constexpr uint64_t MAX_WALK_LENGTH = 48;
+constexpr int MAX_PATTERN_DEPTH = 3;
+
+// pieces of random patterns, kept to the syntax CtRegex takes
+const std::vector<std::string> PATTERN_ATOMS = {
+    "a", "b", "c", "A", "0", "7", "_", "-", " ", ".", ",", "=",
+    "\\.", "\\*", "\\+", "\\?", "\\(", "\\)", "\\[", "\\]", "\\{", "\\|", "\\\\", "\\-", "\\$", "\\^",
+    "\\d", "\\D", "\\w", "\\W", "\\s", "\\S",
+    "[abc]", "[a-c]", "[-a]", "[a-]", "[\\d_]", "[\\w-]", "[.]", "[\\]x]", "[A-Za-z0-9]", "[ -/]",
+};
+
+const std::vector<std::string> QUANTIFIERS = {
+    "*", "+", "?", "{2}", "{0,2}", "{1,}", "{2,3}", "{0}",
+};
+
+// syntax noise, so malformed patterns are checked to fail in both
+const std::string NOISE = "()[]{}|*+?\\^$-.,0123";
+
+// helpers
+
+template <FixedString Pattern, uint32_t Flags = 0>
+CtSample sample() {
+    using Ct = CtRegex<Pattern, Flags>;
+    return {Ct::pattern(), Flags, &Ct::eval};
+}
+
+// one sample per feature of the parser, compiled with the program
+std::vector<CtSample> makeSamples() {
+    return {
+        sample<R"(^\d{1,3}(\.\d{1,3}){3}$)">(),
+        sample<R"(^[A-Za-z0-9._%+\-]+@[A-Za-z0-9.\-]+\.[A-Za-z]{2,}$)">(),
+        sample<R"(^(GET|POST|PUT) /\S* HTTP/1\.[01]$)">(),
+        sample<R"(\d{4}-\d{2}-\d{2})">(),
+        sample<R"((ab|cd)*e?f+)">(),
+        sample<R"(^a.c$)">(),
+        sample<R"(a\$)">(),
+        sample<R"(\\$)">(),
+        sample<R"(^[\w-]{3,5}$)">(),
+        sample<R"((?i)^hello w\Wrld$)">(),
+        sample<R"(^x[^]*y$)", FLAG_ICASE_ASCII>(),
+        sample<R"(^(a|b)*a(a|b){3}$)">(),
+        sample<R"(^(\s|,)+$)">(),
+        sample<R"()">(),
+        sample<R"($)">(),
+        sample<R"(^$)">(),
+    };
+}
+
+std::string makeAtom(std::mt19937& rng, int depth);
+
+std::string makeUnion(std::mt19937& rng, int depth) {
+    std::string res;
+    uint64_t numAlts = 1 + (rng() % 4 == 0) + (rng() % 8 == 0);
+
+    for (uint64_t i = 0; i < numAlts; i++) {
+        if (i) res += '|';
+        uint64_t numPieces = 1 + rng() % 4;
+        for (uint64_t j = 0; j < numPieces; j++) {
+            res += makeAtom(rng, depth);
+            if (rng() % 3 == 0) res += QUANTIFIERS[rng() % QUANTIFIERS.size()];
+        }
+    }
+
+    return res;
+}
+
+std::string makeAtom(std::mt19937& rng, int depth) {
+    if (depth < MAX_PATTERN_DEPTH && rng() % 5 == 0) {
+        std::string res = "(";
+        res += makeUnion(rng, depth + 1);
+        res += ')';
+        return res;
+    }
+    return PATTERN_ATOMS[rng() % PATTERN_ATOMS.size()];
+}
+
+std::string makePattern(std::mt19937& rng) {
+    std::string res;
+    if (rng() % 8 == 0) res += "(?i)";
+    if (rng() % 3 == 0) res += '^';
+    res += makeUnion(rng, 0);
+    if (rng() % 3 == 0) res += '$';
+
+    if (rng() % 5 == 0) {
+        uint64_t numNoise = 1 + rng() % 2;
+        for (uint64_t i = 0; i < numNoise; i++) {
+            res.insert(res.begin() + rng() % (res.size() + 1), NOISE[rng() % NOISE.size()]);
+        }
+    }
+
+    return res;
+}
+
+// the bytes of a random walk from the start, which often ends in a match
+std::string walkMatch(DFA& dfa, std::mt19937& rng) {
+    std::string res;
+    DfaState* state = dfa.start;
+
+    for (uint64_t i = 0; state && i < MAX_WALK_LENGTH; i++) {
+        if (state->isMatch && rng() % 4 == 0) break;
+        if (state->neighbors.empty()) break;
+
+        auto& [l, r, next] = state->neighbors[rng() % state->neighbors.size()];
+        res += static_cast<char>(l + rng() % (static_cast<uint64_t>(r - l) + 1));
+        state = next;
+    }
+
+    return res;
+}
+
+// candidates from walks and from the pattern's own chars, some corrupted
+// so near misses get checked too
+std::string makeCandidate(DFA& dfa, std::string_view pattern, std::mt19937& rng, uint64_t i) {
+    static const std::string extra = "aZ0 \n\t\x80\xFF";
+    std::string res;
+
+    if (i % 2 == 0) res = walkMatch(dfa, rng);
+    else {
+        uint64_t numPieces = rng() % MAX_CANDIDATE_PIECES;
+        for (uint64_t k = 0; k < numPieces; k++) {
+            uint64_t pick = rng() % (pattern.size() + extra.size());
+            res += pick < pattern.size() ? pattern[pick] : extra[pick - pattern.size()];
+        }
+    }
+
+    if (!res.empty() && rng() % 4 == 0) {
+        res[rng() % res.size()] = pattern.empty() ? 'a' : pattern[rng() % pattern.size()];
+    }
+
+    return res;
+}
+
+// nullopt if regexToPostfix or the NFA rejects the pattern
+std::optional<NFA> compileRuntime(std::string_view pattern, uint32_t flags) {
+    try {
+        return NFA(simplifyPostfix(regexToPostfix(ByteView(pattern), flags)));
+    }
+    catch (const std::runtime_error&) {
+        return std::nullopt;
+    }
+}
+
+void report(std::string_view what, std::string_view pattern, uint32_t flags) {
+    std::cerr << what << " for \"" << pattern << "\" with flags " << flags << '\n';
+}
+
+int main() {
+    std::mt19937 rng(11);
+    uint64_t checks = 0;
+
+    for (const CtSample& ct : makeSamples()) {
+        std::optional<NFA> nfa = compileRuntime(ct.pattern, ct.flags);
+        if (!nfa) {
+            report("CtRegex compiles a pattern regexToPostfix rejects", ct.pattern, ct.flags);
+            return 1;
+        }
+        DFA dfa(*nfa);
+        uint64_t matches = 0;
+
+        for (uint64_t i = 0; i < CHECKS_PER_SAMPLE; i++) {
+            std::string candidate = makeCandidate(dfa, ct.pattern, rng, i);
+            bool expected = dfa.eval(ByteView(candidate));
+
+            if (ct.eval(candidate) != expected) {
+                report("CtRegex disagrees with DFA::eval on \"" + candidate + "\"",
+                       ct.pattern, ct.flags);
+                return 1;
+            }
+
+            matches += expected;
+            checks++;
+        }
+
+        std::cout << ct.pattern << ": " << matches << " / " << CHECKS_PER_SAMPLE << " matched\n";
+    }
+
+    uint64_t compiled = 0;
+    for (uint64_t i = 0; i < NUM_RANDOM_PATTERNS; i++) {
+        std::string pattern = makePattern(rng);
+        uint32_t flags = rng() % 6 == 0 ? FLAG_ICASE_ASCII : 0;
+
+        std::optional<NFA> nfa = compileRuntime(pattern, flags);
+        std::optional<CtDfa> ct;
+        try {
+            ct = ctCompile(pattern, flags);
+        }
+        catch (const std::runtime_error& e) {
+            // only compile time limits may fail where the runtime does not
+            if (std::string_view(e.what()).find("too large") != std::string_view::npos) continue;
+        }
+
+        if (nfa.has_value() != ct.has_value()) {
+            report(nfa ? "ctCompile rejects a pattern regexToPostfix takes"
+                       : "ctCompile takes a pattern regexToPostfix rejects", pattern, flags);
+            return 1;
+        }
+        if (!nfa) continue;
+
+        DFA dfa(*nfa);
+        compiled++;
+
+        for (uint64_t j = 0; j < CHECKS_PER_PATTERN; j++) {
+            std::string candidate = makeCandidate(dfa, pattern, rng, j);
+
+            if (ct->eval(candidate) != dfa.eval(ByteView(candidate))) {
+                report("ctCompile disagrees with DFA::eval on \"" + candidate + "\"",
+                       pattern, flags);
+                return 1;
+            }
+            checks++;
+        }
+    }
+
+    std::cout << "random patterns: " << compiled << " / " << NUM_RANDOM_PATTERNS << " compiled\n";
+    std::cout << "ok " << checks << " checks\n";
+    return 0;
+}
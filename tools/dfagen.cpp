@@ -0,0 +1,344 @@
+// Generates a self-contained C++ source file with one switch/goto matcher
+// per pattern, from the minimized eager DFA of each.
+//
+// usage: ./tools/dfagen [--bytes] [-o out.cpp] rules.txt
+//
+// every non-empty line of rules.txt that does not start with # is a C++
+// identifier and a pattern, separated by whitespace. The output defines
+// bool <name>(std::string_view) for each and the GENERATED_MATCHERS table.
+// Candidates are decoded like UTF8View in LENIENT mode, or as bytes with
+// --bytes
+
+#include "cache.hpp"
+
+#include <fstream>
+#include <map>
+#include <sstream>
+
+// constants
+
+// ascii ranges up to this size become case labels, longer ones comparisons
+constexpr uint64_t MAX_CASE_RANGE = 16;
+
+// data structures
+
+struct Rule {
+    std::string name;
+    std::string pattern;
+};
+
+// a DFA with states numbered from 0, -1 is the dead state
+struct Machine {
+    int start = -1;
+    std::vector<bool> accept;
+    std::vector<std::vector<Interval<int>>> next;
+};
+
+// helpers
+
+std::vector<Rule> readRules(std::istream& in) {
+    std::vector<Rule> rules;
+    std::string line;
+
+    for (int lineNum = 1; std::getline(in, line); lineNum++) {
+        uint64_t begin = line.find_first_not_of(" \t");
+        if (begin == std::string::npos || line[begin] == '#') continue;
+
+        uint64_t split = line.find_first_of(" \t", begin);
+        uint64_t patternBegin = line.find_first_not_of(" \t", split);
+
+        Rule rule;
+        rule.name = line.substr(begin, split - begin);
+        if (patternBegin != std::string::npos) rule.pattern = line.substr(patternBegin);
+
+        bool identifier = !rule.name.empty() && !std::isdigit(rule.name[0]) &&
+            std::all_of(rule.name.begin(), rule.name.end(), [](char c) {
+                return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+            });
+        if (!identifier) {
+            throw std::runtime_error("line " + std::to_string(lineNum) + ": " +
+                                     rule.name + " is not an identifier");
+        }
+
+        rules.push_back(std::move(rule));
+    }
+
+    return rules;
+}
+
+// Moore's algorithm over the elementary intervals of all transitions: states
+// are split by acceptance, then by the blocks their transitions lead to,
+// until no block splits
+Machine minimize(DFA& dfa) {
+    Machine res;
+    if (dfa.start == nullptr) return res;
+
+    std::vector<DfaState*> states = {dfa.start};
+    HashMap<DfaState*, int> ids = {{dfa.start, 0}};
+
+    for (uint64_t i = 0; i < states.size(); i++) {
+        for (auto& [l, r, next] : states[i]->neighbors) {
+            if (ids.try_emplace(next, states.size()).second) states.push_back(next);
+        }
+    }
+
+    // chars no transition tells apart
+    std::vector<uint64_t> bounds = {0, static_cast<uint64_t>(MAX_CHAR) + 1};
+    for (DfaState* state : states) {
+        for (auto& [l, r, next] : state->neighbors) {
+            bounds.push_back(l);
+            bounds.push_back(static_cast<uint64_t>(r) + 1);
+        }
+    }
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+    uint64_t numClasses = bounds.size() - 1;
+
+    // state n is the dead state, so states that can never match join it
+    int n = states.size();
+    std::vector<std::vector<int>> trans(n + 1, std::vector<int>(numClasses, n));
+
+    for (int i = 0; i < n; i++) {
+        uint64_t k = 0;
+        for (auto& [l, r, next] : states[i]->neighbors) {
+            while (bounds[k] < l) k++;
+            for (; k < numClasses && bounds[k] <= r; k++) trans[i][k] = ids[next];
+        }
+    }
+
+    std::vector<int> block(n + 1);
+    for (int i = 0; i < n; i++) block[i] = states[i]->isMatch;
+    block[n] = 0;
+
+    for (int numBlocks = 0;;) {
+        std::map<std::vector<int>, int> signatures;
+        std::vector<int> refined(n + 1);
+
+        for (int i = 0; i <= n; i++) {
+            std::vector<int> signature = {block[i]};
+            for (int target : trans[i]) signature.push_back(block[target]);
+            refined[i] = signatures.try_emplace(std::move(signature), signatures.size()).first->second;
+        }
+
+        block = std::move(refined);
+        if (static_cast<int>(signatures.size()) == numBlocks) break;
+        numBlocks = signatures.size();
+    }
+
+    // blocks renumbered in the order they are reached, without the dead one
+    std::vector<int> order(n + 1, -1);
+    std::vector<int> members(n + 1, -1);
+    int dead = block[n];
+    order[dead] = -2;
+
+    std::vector<int> queue = {block[0]};
+    order[block[0]] = 0;
+    for (int i = 0; i <= n; i++) {
+        if (members[block[i]] < 0) members[block[i]] = i;
+    }
+
+    for (uint64_t q = 0; q < queue.size(); q++) {
+        int member = members[queue[q]];
+        res.accept.push_back(member < n && states[member]->isMatch);
+        res.next.emplace_back();
+
+        for (uint64_t k = 0; k < numClasses; k++) {
+            int target = block[trans[member][k]];
+            if (order[target] == -1) {
+                order[target] = queue.size();
+                queue.push_back(target);
+            }
+            if (target == dead) continue;
+
+            char_t l = bounds[k], r = bounds[k + 1] - 1;
+            auto& next = res.next.back();
+            if (!next.empty() && next.back().item == order[target] && next.back().r + 1 == l) {
+                next.back().r = r;
+            }
+            else next.push_back({l, r, order[target]});
+        }
+    }
+
+    res.start = block[0] == dead ? -1 : 0;
+    return res;
+}
+
+std::string charLiteral(char_t c) {
+    if (c >= 0x20 && c < 0x7F && c != '\'' && c != '\\') return std::string("'") + static_cast<char>(c) + "'";
+    std::ostringstream out;
+    out << "0x" << std::hex << std::uppercase << static_cast<uint64_t>(c);
+    return out.str();
+}
+
+std::string cppString(const std::string& str) {
+    std::ostringstream out;
+    out << '"';
+    for (unsigned char c : str) {
+        if (c == '"' || c == '\\') out << '\\' << c;
+        else if (c >= 0x20 && c < 0x7F) out << c;
+        else out << "\\" << std::oct << static_cast<int>(c) / 64 << (c / 8) % 8 << c % 8 << std::dec;
+    }
+    out << '"';
+    return out.str();
+}
+
+void emitMatcher(std::ostream& out, const Rule& rule, const Machine& machine, bool bytes) {
+    out << "// " << cppString(rule.pattern) << "\n";
+    out << "bool " << rule.name << "(std::string_view candidate) {\n";
+
+    if (machine.start < 0 && machine.next.empty()) {
+        // the empty regex
+        out << "    return candidate.empty();\n}\n\n";
+        return;
+    }
+
+    out << "    const unsigned char* p = reinterpret_cast<const unsigned char*>(candidate.data());\n";
+    out << "    const unsigned char* end = p + candidate.size();\n";
+    out << "    char32_t c;\n\n";
+
+    if (machine.start < 0) {
+        out << "    (void)p;\n    (void)end;\n    (void)c;\n    return false;\n}\n\n";
+        return;
+    }
+
+    // a single byte for ascii, always small enough for a switch
+    uint64_t switchLimit = bytes ? 0xFF : 0x7F;
+
+    // the start state is reached by falling through, unused labels are errors
+    std::vector<bool> targeted(machine.next.size());
+    for (const auto& next : machine.next) {
+        for (const Interval<int>& range : next) targeted[range.item] = true;
+    }
+
+    for (uint64_t i = 0; i < machine.next.size(); i++) {
+        if (targeted[i]) out << "s" << i << ":\n";
+        out << "    if (p == end) return " << (machine.accept[i] ? "true" : "false") << ";\n";
+        out << (bytes ? "    c = *p++;\n" : "    c = nextChar(p, end);\n");
+
+        std::vector<const Interval<int>*> cases, compares;
+        for (const Interval<int>& range : machine.next[i]) {
+            bool small = range.r - range.l < MAX_CASE_RANGE;
+            (range.r <= switchLimit && small ? cases : compares).push_back(&range);
+        }
+
+        if (!cases.empty()) {
+            out << "    switch (c) {\n";
+            for (const Interval<int>* range : cases) {
+                out << "    ";
+                for (char_t c = range->l; c <= range->r; c++) out << " case " << charLiteral(c) << ":";
+                out << " goto s" << range->item << ";\n";
+            }
+            out << "    default: break;\n    }\n";
+        }
+
+        for (const Interval<int>* range : compares) {
+            out << "    if (c >= " << charLiteral(range->l) << " && c <= " << charLiteral(range->r)
+                << ") goto s" << range->item << ";\n";
+        }
+
+        out << "    return false;\n\n";
+    }
+
+    out << "}\n\n";
+}
+
+const char* PRELUDE = R"(// generated by tools/dfagen, do not edit
+
+#include <cstddef>
+#include <string_view>
+
+struct GeneratedMatcher {
+    const char* name;
+    const char* pattern;
+    bool bytes;
+    bool (*match)(std::string_view);
+};
+
+)";
+
+// decodes like UTF8View in LENIENT mode: the length announced by the lead
+// byte, cut short by anything that is not a continuation byte
+const char* NEXT_CHAR = R"(static inline char32_t nextChar(const unsigned char*& p, const unsigned char* end) {
+    char32_t c = *p;
+    if (c < 0x80) {
+        p++;
+        return c;
+    }
+
+    int want = (c & 0x20) == 0 ? 2 : (c & 0x10) == 0 ? 3 : (c & 0x08) == 0 ? 4 : 1;
+    if ((c & 0xC0) == 0x80) want = 1;
+
+    int len = 1;
+    while (len < want && p + len < end && (p[len] & 0xC0) == 0x80) len++;
+
+    if (len > 1) {
+        c &= 0x7F >> len;
+        for (int i = 1; i < len; i++) c = c << 6 | (p[i] & 0x3F);
+    }
+
+    p += len;
+    return c;
+}
+
+)";
+
+int main(int argc, char** argv) {
+    bool bytes = false;
+    std::string input, output;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--bytes") bytes = true;
+        else if (arg == "-o" && i + 1 < argc) output = argv[++i];
+        else input = arg;
+    }
+
+    if (input.empty()) {
+        std::cerr << "usage: " << argv[0] << " [--bytes] [-o out.cpp] rules.txt\n";
+        return 1;
+    }
+
+    try {
+        std::ifstream in(input);
+        if (!in) throw std::runtime_error("cannot read " + input);
+
+        std::ostringstream code;
+        code << PRELUDE;
+        if (!bytes) code << NEXT_CHAR;
+
+        std::vector<Rule> rules = readRules(in);
+
+        for (const Rule& rule : rules) {
+            NFA nfa(compilePostfix(rule.pattern, bytes ? Encoding::BYTES : Encoding::UTF8));
+            DFA dfa(nfa);
+
+            Machine machine = minimize(dfa);
+            std::cerr << rule.name << ": " << dfa.numStates() << " DFA states, "
+                      << machine.next.size() << " minimized\n";
+
+            emitMatcher(code, rule, machine, bytes);
+        }
+
+        code << "extern const GeneratedMatcher GENERATED_MATCHERS[] = {\n";
+        for (const Rule& rule : rules) {
+            code << "    {\"" << rule.name << "\", " << cppString(rule.pattern) << ", "
+                 << (bytes ? "true" : "false") << ", " << rule.name << "},\n";
+        }
+        if (rules.empty()) code << "    {nullptr, nullptr, false, nullptr},\n";
+        code << "};\n\n";
+        code << "extern const size_t NUM_GENERATED_MATCHERS = " << rules.size() << ";\n";
+
+        if (output.empty()) std::cout << code.str();
+        else {
+            std::ofstream out(output);
+            out << code.str();
+            if (!out) throw std::runtime_error("cannot write " + output);
+        }
+    }
+    catch (std::exception& e) {
+        std::cerr << "dfagen: " << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,121 @@
+// checks the matchers generated by tools/dfagen against DFA::eval on random
+// candidates, exits with 1 on the first disagreement
+
+#include "dfa.hpp"
+#include "ast.hpp"
+
+#include <random>
+
+// data structures
+
+// same layout as the struct in the generated file
+struct GeneratedMatcher {
+    const char* name;
+    const char* pattern;
+    bool bytes;
+    bool (*match)(std::string_view);
+};
+
+extern const GeneratedMatcher GENERATED_MATCHERS[];
+extern const size_t NUM_GENERATED_MATCHERS;
+
+// constants
+
+constexpr uint64_t CHECKS_PER_MATCHER = 20000;
+constexpr uint64_t MAX_CANDIDATE_PIECES = 24;
+constexpr uint64_t MAX_WALK_LENGTH = 64;
+
+// helpers
+
+// pieces of the candidates: every char of the pattern, so matches are
+// likely, plus chars of every utf8 length and a stray byte
+std::vector<std::string> makePieces(std::string_view pattern) {
+    std::vector<std::string> pieces = {"a", "Z", "0", "9", " ", "é", "€", "🚀", "\xFF", "\x80"};
+    for (char c : pattern) pieces.push_back(std::string(1, c));
+    return pieces;
+}
+
+// the chars of a random walk from the start, which often ends in a match
+std::string walkMatch(DFA& dfa, std::mt19937& rng, bool bytes) {
+    std::string res;
+    DfaState* state = dfa.start;
+
+    for (uint64_t i = 0; state && i < MAX_WALK_LENGTH; i++) {
+        if (state->isMatch && rng() % 4 == 0) break;
+        if (state->neighbors.empty()) break;
+
+        auto& [l, r, next] = state->neighbors[rng() % state->neighbors.size()];
+        char_t c = l + rng() % (static_cast<uint64_t>(r - l) + 1);
+
+        if (bytes || c < 0x80) res += static_cast<char>(c);
+        else if (c < 0x800) {
+            res += static_cast<char>(0xC0 | c >> 6);
+            res += static_cast<char>(0x80 | (c & 0x3F));
+        }
+        else if (c < 0x10000) {
+            res += static_cast<char>(0xE0 | c >> 12);
+            res += static_cast<char>(0x80 | (c >> 6 & 0x3F));
+            res += static_cast<char>(0x80 | (c & 0x3F));
+        }
+        else if (c < 0x110000) {
+            res += static_cast<char>(0xF0 | c >> 18);
+            res += static_cast<char>(0x80 | (c >> 12 & 0x3F));
+            res += static_cast<char>(0x80 | (c >> 6 & 0x3F));
+            res += static_cast<char>(0x80 | (c & 0x3F));
+        }
+        state = next;
+    }
+
+    return res;
+}
+
+int main() {
+    std::mt19937 rng(7);
+    uint64_t checks = 0;
+
+    for (size_t i = 0; i < NUM_GENERATED_MATCHERS; i++) {
+        const GeneratedMatcher& matcher = GENERATED_MATCHERS[i];
+        std::string pattern = matcher.pattern;
+
+        Postfix postfix = matcher.bytes ? regexToPostfix(ByteView(pattern))
+                                        : regexToPostfix(UTF8View(pattern));
+        NFA nfa(simplifyPostfix(std::move(postfix)));
+        DFA dfa(nfa);
+
+        std::vector<std::string> pieces = makePieces(pattern);
+        uint64_t matches = 0;
+
+        for (uint64_t j = 0; j < CHECKS_PER_MATCHER; j++) {
+            std::string candidate;
+
+            if (j % 2 == 0) candidate = walkMatch(dfa, rng, matcher.bytes);
+            else {
+                uint64_t numPieces = rng() % MAX_CANDIDATE_PIECES;
+                for (uint64_t k = 0; k < numPieces; k++) candidate += pieces[rng() % pieces.size()];
+            }
+
+            // a few corruptions so near misses get checked too
+            if (!candidate.empty() && rng() % 4 == 0) {
+                candidate[rng() % candidate.size()] = pieces[rng() % pieces.size()][0];
+            }
+
+            bool expected = matcher.bytes ? dfa.eval(ByteView(candidate))
+                                          : dfa.eval(UTF8View(candidate));
+            bool actual = matcher.match(candidate);
+
+            if (expected != actual) {
+                std::cerr << matcher.name << " disagrees with DFA::eval on \"" << candidate
+                          << "\": expected " << expected << ", got " << actual << '\n';
+                return 1;
+            }
+
+            matches += expected;
+            checks++;
+        }
+
+        std::cout << matcher.name << ": " << matches << " / " << CHECKS_PER_MATCHER << " matched\n";
+    }
+
+    std::cout << "ok " << checks << " checks\n";
+    return 0;
+}
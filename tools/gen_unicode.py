@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+# Generates unicode_tables.cpp, the general category and White_Space ranges
+# behind \p{...}, \d, \w and \s and the simple case folding orbits behind
+# (?i), from the unicodedata module.
+#
+# usage: python3 tools/gen_unicode.py > unicode_tables.cpp
+
+import sys
+import unicodedata
+
+MAX_CODE_POINT = 0x10FFFF
+
+# White_Space from PropList.txt, not exposed by unicodedata
+WHITE_SPACE = [
+    (0x09, 0x0D), (0x20, 0x20), (0x85, 0x85), (0xA0, 0xA0), (0x1680, 0x1680),
+    (0x2000, 0x200A), (0x2028, 0x2029), (0x202F, 0x202F), (0x205F, 0x205F),
+    (0x3000, 0x3000),
+]
+
+
+def to_ranges(code_points):
+    ranges = []
+    for c in code_points:
+        if ranges and ranges[-1][1] == c - 1:
+            ranges[-1][1] = c
+        else:
+            ranges.append([c, c])
+    return ranges
+
+
+# delta markers shared with unicode.hpp
+EVEN_ODD = 1 << 30
+ODD_EVEN = EVEN_ODD + 1
+
+
+def fold_orbits():
+    """next(c) for every c whose simple case folding orbit is nontrivial"""
+    parent = list(range(MAX_CODE_POINT + 1))
+
+    def find(c):
+        while parent[c] != c:
+            parent[c] = parent[parent[c]]
+            c = parent[c]
+        return c
+
+    # simple folding: the full casefold if it is a single char, else lower
+    for c in range(MAX_CODE_POINT + 1):
+        for fold in (str.casefold, str.lower):
+            mapped = fold(chr(c))
+            if len(mapped) == 1:
+                parent[find(c)] = find(ord(mapped))
+                break
+
+    orbits = {}
+    for c in range(MAX_CODE_POINT + 1):
+        orbits.setdefault(find(c), []).append(c)
+
+    nxt = {}
+    for orbit in orbits.values():
+        for i, c in enumerate(orbit):
+            if len(orbit) > 1:
+                nxt[c] = orbit[(i + 1) % len(orbit)]
+    return nxt
+
+
+def fold_ranges(nxt):
+    """compresses next(c) into (lo, hi, delta) runs like RE2's CaseFold"""
+    entries = []
+    for c in sorted(nxt):
+        delta = nxt[c] - c
+        if delta == 1 and c % 2 == 0 or delta == -1 and c % 2 == 1:
+            delta = EVEN_ODD
+        elif delta == 1 and c % 2 == 1 or delta == -1 and c % 2 == 0:
+            delta = ODD_EVEN
+
+        if entries and entries[-1][1] == c - 1 and entries[-1][2] == delta:
+            entries[-1][1] = c
+        else:
+            entries.append([c, c, delta])
+    return entries
+
+
+def main():
+    categories = {}
+    for c in range(MAX_CODE_POINT + 1):
+        category = unicodedata.category(chr(c))
+        if category != "Cn":
+            categories.setdefault(category, []).append(c)
+
+    tables = {name: to_ranges(cps) for name, cps in sorted(categories.items())}
+    tables["White_Space"] = [list(r) for r in WHITE_SPACE]
+
+    out = sys.stdout
+    out.write("// generated by tools/gen_unicode.py from Unicode %s, do not edit\n\n"
+              % unicodedata.unidata_version)
+    out.write('#include "unicode.hpp"\n\n')
+    out.write("namespace {\n\n")
+
+    for name, ranges in tables.items():
+        out.write("constexpr ClassInterval %s[] = {\n" % name)
+        for i in range(0, len(ranges), 4):
+            row = ", ".join("{0x%X, 0x%X}" % (l, r) for l, r in ranges[i:i + 4])
+            out.write("    %s,\n" % row)
+        out.write("};\n\n")
+
+    out.write("} // namespace\n\n")
+    out.write("const UnicodeProperty UNICODE_PROPERTIES[] = {\n")
+    for name in tables:
+        out.write('    {"%s", %s, std::size(%s)},\n' % (name, name, name))
+    out.write("};\n\n")
+    out.write("const size_t NUM_UNICODE_PROPERTIES = std::size(UNICODE_PROPERTIES);\n\n")
+
+    names = {EVEN_ODD: "EVEN_ODD", ODD_EVEN: "ODD_EVEN"}
+    out.write("const CaseFold CASE_FOLDS[] = {\n")
+    for lo, hi, delta in fold_ranges(fold_orbits()):
+        out.write("    {0x%X, 0x%X, %s},\n" % (lo, hi, names.get(delta, str(delta))))
+    out.write("};\n\n")
+    out.write("const size_t NUM_CASE_FOLDS = std::size(CASE_FOLDS);\n")
+
+
+if __name__ == "__main__":
+    main()
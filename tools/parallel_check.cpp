@@ -0,0 +1,232 @@
+// checks everything that matches or builds on several threads against a
+// sequential DFA: parallel eager builds, BatchMatcher, SpeculativeMatcher
+// and LazyBuilder. Exits with 1 on the first disagreement. Meant to also
+// run under SANITIZE=thread
+
+#include "speculative.hpp"
+#include "builder.hpp"
+
+#include <random>
+
+// constants
+
+constexpr uint64_t BATCH_MATCHERS = 40;
+constexpr uint64_t MAX_BATCH_SIZE = 3000;
+constexpr uint64_t SPECULATIVE_MATCHERS = 60;
+constexpr uint64_t BUILDER_RUNS = 30;
+constexpr uint64_t MAX_BUILDER_CANDIDATES = 3000;
+
+const std::vector<std::string> BUILD_PATTERNS = {
+    "^[ab]*a[ab]{10}$", "(ab|ba)*c", "a.*b.*c", "^(x|y)*z?$", "[a-c]{3}d", "", "é[ab]+",
+    "(foo|bar|baz)+[0-9]{2,5}", "\\p{L}+x", "^(a|b|c|d)*(abc|bcd|cda){3}$",
+    "[a-z]{2}[0-9]{3}|[0-9]{2}[a-z]{3}",
+};
+
+const std::vector<std::string> MATCH_PATTERNS = {
+    "a(b|c)*d", "^[ab]*$", "(?i)err", "é.", "", ".*x.*y", "^$", "[ab]*a[ab]{6}$", "^(ab|c)*$",
+    "x[ab]", "^.*$", "é{3}", "[a-c]+d[a-c]+$",
+};
+
+// pieces of candidates, with broken utf8 for the utf8 modes
+const std::vector<std::string> PIECES = {
+    "a", "b", "c", "d", "x", "y", "é", "\xC3", "\x80", "\xE2\x82", "E", "r", "1",
+};
+
+// helpers
+
+uint64_t checks = 0;
+
+bool check(bool ok, const std::string& what) {
+    if (!ok) std::cerr << "failed: " << what << '\n';
+    checks++;
+    return ok;
+}
+
+std::string makeCandidate(std::mt19937& rng, uint64_t length, uint64_t numPieces) {
+    std::string res;
+    while (res.size() < length) res += PIECES[rng() % numPieces];
+    return res;
+}
+
+bool evalDfa(DFA& dfa, std::string_view candidate, Encoding encoding,
+             Utf8Mode mode = Utf8Mode::LENIENT) {
+    if (encoding == Encoding::BYTES) return dfa.eval(ByteView(candidate));
+    return dfa.eval(UTF8View(candidate, mode));
+}
+
+// walks both DFAs together, their states have to map one to one
+bool isomorphic(DFA& a, DFA& b) {
+    if (!a.start || !b.start) return a.start == b.start;
+
+    HashMap<DfaState*, DfaState*> forward = {{a.start, b.start}};
+    HashMap<DfaState*, DfaState*> backward = {{b.start, a.start}};
+    std::vector<DfaState*> stk = {a.start};
+
+    while (!stk.empty()) {
+        DfaState* x = stk.back();
+        stk.pop_back();
+        DfaState* y = forward[x];
+
+        if (x->isMatch != y->isMatch || x->matchIds != y->matchIds ||
+                x->stickyIds != y->stickyIds || x->numEscapes != y->numEscapes ||
+                x->neighbors.size() != y->neighbors.size()) {
+            return false;
+        }
+
+        for (uint64_t i = 0; i < x->neighbors.size(); i++) {
+            auto& [l1, r1, next1] = x->neighbors[i];
+            auto& [l2, r2, next2] = y->neighbors[i];
+            if (l1 != l2 || r1 != r2) return false;
+
+            auto [it, fresh] = forward.try_emplace(next1, next2);
+            if (!fresh && it->second != next2) return false;
+
+            auto [jt, freshBack] = backward.try_emplace(next2, next1);
+            if (!freshBack && jt->second != next1) return false;
+
+            if (fresh) stk.push_back(next1);
+        }
+    }
+
+    return true;
+}
+
+bool checkParallelBuild() {
+    for (const std::string& pattern : BUILD_PATTERNS) {
+        NFA nfa(compilePostfix(pattern, Encoding::UTF8));
+        DFA sequential(nfa, false, 1);
+
+        for (unsigned numThreads : {2u, 3u, 8u}) {
+            DFA parallel(nfa, false, numThreads);
+            bool same = sequential.numStates() == parallel.numStates() &&
+                        isomorphic(sequential, parallel);
+
+            if (!check(same, "DFA built on " + std::to_string(numThreads) + " threads for \"" +
+                             pattern + "\"")) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool checkBatch(std::mt19937& rng) {
+    for (uint64_t i = 0; i < BATCH_MATCHERS; i++) {
+        const std::string& pattern = MATCH_PATTERNS[rng() % MATCH_PATTERNS.size()];
+        bool lazy = rng() % 2;
+        Encoding encoding = rng() % 2 ? Encoding::BYTES : Encoding::UTF8;
+        unsigned numThreads = 1 + rng() % 6;
+        uint64_t chunkSize = rng() % 3 ? 0 : rng() % 300;
+
+        BatchMatcher batch(pattern, lazy, encoding, 0, numThreads, chunkSize);
+        NFA nfa(compilePostfix(pattern, encoding));
+        DFA reference(nfa, true);
+
+        for (int j = 0; j < 3; j++) {
+            std::vector<std::string> candidates(rng() % MAX_BATCH_SIZE);
+            for (std::string& candidate : candidates) {
+                candidate = makeCandidate(rng, rng() % 12, PIECES.size());
+            }
+
+            std::vector<std::string_view> views(candidates.begin(), candidates.end());
+            std::string data;
+            std::vector<uint64_t> offsets = {0};
+            for (const std::string& candidate : candidates) {
+                data += candidate;
+                offsets.push_back(data.size());
+            }
+
+            std::vector<uint64_t> bits = batch.eval(views);
+            const std::vector<uint64_t>& packed = batch.eval(data, offsets);
+
+            for (uint64_t k = 0; k < candidates.size(); k++) {
+                bool expected = evalDfa(reference, candidates[k], encoding);
+                bool same = BatchMatcher::matched(bits, k) == expected &&
+                            BatchMatcher::matched(packed, k) == expected;
+
+                if (!check(same, "BatchMatcher for \"" + pattern + "\" on \"" + candidates[k] + "\"")) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+bool checkSpeculative(std::mt19937& rng) {
+    for (uint64_t i = 0; i < SPECULATIVE_MATCHERS; i++) {
+        const std::string& pattern = MATCH_PATTERNS[rng() % MATCH_PATTERNS.size()];
+        Encoding encoding = rng() % 2 ? Encoding::BYTES : Encoding::UTF8;
+        unsigned numThreads = 1 + rng() % 4;
+        uint64_t chunkSize = rng() % 2 ? 0 : 1 + rng() % 5000;
+        Utf8Mode mode = static_cast<Utf8Mode>(rng() % 3);
+
+        SpeculativeMatcher speculative(pattern, encoding, 0, numThreads, chunkSize);
+        speculative.setUtf8Mode(mode);
+        NFA nfa(compilePostfix(pattern, encoding));
+        DFA reference(nfa, true);
+
+        for (int j = 0; j < 3; j++) {
+            // mostly above the size matched on the calling thread
+            uint64_t length = rng() % 3 ? 65536 + rng() % 100000 : rng() % 100;
+            std::string input = makeCandidate(rng, length, std::vector<uint64_t>{2, 7, 12}[rng() % 3]);
+
+            bool expected = evalDfa(reference, input, encoding, mode);
+            if (!check(speculative.eval(input) == expected,
+                       "SpeculativeMatcher for \"" + pattern + "\" on " +
+                       std::to_string(input.size()) + " bytes")) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool checkBuilder(std::mt19937& rng) {
+    for (uint64_t i = 0; i < BUILDER_RUNS; i++) {
+        const std::string& pattern = BUILD_PATTERNS[rng() % BUILD_PATTERNS.size()];
+        NFA nfa(compilePostfix(pattern, Encoding::UTF8));
+        DFA reference(nfa);
+        DFA lazy(nfa, true);
+
+        {
+            LazyBuilder builder(lazy, rng() % 2 ? 1 << 20 : 4000, 1 + rng() % 8);
+            uint64_t numCandidates = rng() % MAX_BUILDER_CANDIDATES;
+
+            for (uint64_t j = 0; j < numCandidates; j++) {
+                std::string candidate = makeCandidate(rng, rng() % 30, 7);
+                bool expected = evalDfa(reference, candidate, Encoding::UTF8);
+
+                if (!check(evalDfa(lazy, candidate, Encoding::UTF8) == expected,
+                           "DFA with a LazyBuilder for \"" + pattern + "\" on \"" + candidate + "\"")) {
+                    return false;
+                }
+
+                if (j == numCandidates / 2 && rng() % 4 == 0) builder.cancel();
+            }
+        }
+
+        // left to the matching thread alone
+        if (!check(evalDfa(lazy, "abab", Encoding::UTF8) == evalDfa(reference, "abab", Encoding::UTF8),
+                   "DFA after its LazyBuilder for \"" + pattern + "\"")) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main() {
+    std::mt19937 rng(50);
+
+    if (!checkParallelBuild()) return 1;
+    if (!checkBatch(rng)) return 1;
+    if (!checkSpeculative(rng)) return 1;
+    if (!checkBuilder(rng)) return 1;
+
+    std::cout << "ok " << checks << " checks\n";
+    return 0;
+}
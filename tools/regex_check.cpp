@@ -0,0 +1,149 @@
+// checks Regex, JitDfa and Lexer paths that random matching rarely
+// reaches, exits with 1 on the first failure
+
+#include "main.hpp"
+#include "lexer.hpp"
+
+#include <random>
+
+// constants
+
+constexpr uint64_t RANDOM_CANDIDATES = 2000;
+constexpr uint64_t MAX_CANDIDATE_LENGTH = 40;
+
+// helpers
+
+uint64_t checks = 0;
+
+bool check(bool ok, const std::string& what) {
+    if (!ok) std::cerr << "failed: " << what << '\n';
+    checks++;
+    return ok;
+}
+
+std::string randomCandidate(std::mt19937& rng, std::string_view chars) {
+    std::string res(rng() % MAX_CANDIDATE_LENGTH, ' ');
+    for (char& c : res) c = chars[rng() % chars.size()];
+    return res;
+}
+
+// a lazy DFA over the JIT limit: freezing gives up after filling part of
+// it, and the JitDfa has to answer like DFA::eval instead of stepping the
+// states that were never filled
+bool checkJitFallback(std::mt19937& rng) {
+    std::string pattern = "(a|b)*a(a|b){17}";
+    NFA nfa(simplifyPostfix(regexToPostfix(ByteView(pattern))));
+
+    for (Encoding encoding : {Encoding::BYTES, Encoding::UTF8}) {
+        DFA dfa(nfa, true);
+        JitDfa jit(dfa, encoding);
+        DFA reference(nfa, true);
+
+        if (!check(!jit.compiled() && jit.numStates() == 0, "JitDfa over the state limit")) {
+            return false;
+        }
+
+        std::vector<std::string> candidates = {"a" + std::string(17, 'b'), std::string(18, 'b')};
+        for (uint64_t i = 0; i < RANDOM_CANDIDATES; i++) {
+            candidates.push_back(randomCandidate(rng, "ab"));
+        }
+
+        for (const std::string& candidate : candidates) {
+            bool expected = reference.eval(ByteView(candidate));
+            bool actual = encoding == Encoding::BYTES ? jit.eval(ByteView(candidate))
+                                                      : jit.eval(UTF8View(candidate));
+            if (!check(actual == expected, "JitDfa fallback on \"" + candidate + "\"")) {
+                return false;
+            }
+        }
+    }
+
+    // the same through Regex
+    Regex regex(pattern, true, true, Encoding::BYTES);
+    regex.setJit(true);
+    return check(!regex.jitCompiled() && regex.eval("a" + std::string(17, 'b')),
+                 "Regex with a JitDfa over the state limit");
+}
+
+// regexes moved while their builders fill the lazy DFA, by construction
+// and by assignment over a regex whose builder is running too. Meant to run
+// under SANITIZE=address
+bool checkMoveWithBuilder(std::mt19937& rng) {
+    std::string pattern = "^[ab]*a[ab]{12}$";
+    NFA nfa(compilePostfix(pattern, Encoding::BYTES));
+    DFA reference(nfa, true);
+
+    auto make = [&pattern]() {
+        Regex res;
+        res.setBackgroundBuild(1ULL << 30);
+        res.setRegex(pattern, true, true, Encoding::BYTES);
+        return res;
+    };
+
+    std::vector<Regex> regexes;
+    for (int i = 0; i < 4; i++) {
+        Regex regex = make();
+        regexes.push_back(std::move(regex));
+    }
+
+    Regex moved = make();
+    moved = std::move(regexes[0]);
+    regexes[0] = make();
+    regexes.push_back(std::move(moved));
+
+    for (uint64_t i = 0; i < RANDOM_CANDIDATES; i++) {
+        std::string candidate = randomCandidate(rng, "ab");
+        bool expected = reference.eval(ByteView(candidate));
+
+        for (Regex& regex : regexes) {
+            if (!check(regex.eval(candidate) == expected, "moved Regex on \"" + candidate + "\"")) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// anchors written out on tokens, and REJECT mode in next as in tokenize
+bool checkLexer() {
+    Lexer lexer({"^abc", "abc$", "(?i)^if$", "a\\$", "[ab]."});
+    bool ok = check(lexer.next("abc", 0).id == 0, "Lexer token with a leading ^") &&
+              check(Lexer({"abc$"}).next("abc", 0).id == 0, "Lexer token with a trailing $") &&
+              check(lexer.next("IF", 0).id == 2, "Lexer token with (?i) and anchors") &&
+              check(lexer.next("a$", 0) == Lexeme{3, 0, 2}, "Lexer token with an escaped $");
+    if (!ok) return false;
+
+    bool refused = false;
+    try {
+        Lexer({"^$"});
+    }
+    catch (const std::runtime_error&) {
+        refused = true;
+    }
+    if (!check(refused, "Lexer token of only anchors")) return false;
+
+    lexer.setUtf8Mode(Utf8Mode::REJECT);
+    std::string malformed = "b\xFF";
+
+    bool threw = false;
+    try {
+        lexer.next(malformed, 0);
+    }
+    catch (const std::runtime_error&) {
+        threw = true;
+    }
+    return check(threw, "Lexer::next on malformed input under REJECT") &&
+           check(lexer.next("abc\xFF", 0).id == 0, "Lexer::next before malformed input");
+}
+
+int main() {
+    std::mt19937 rng(5);
+
+    if (!checkJitFallback(rng)) return 1;
+    if (!checkMoveWithBuilder(rng)) return 1;
+    if (!checkLexer()) return 1;
+
+    std::cout << "ok " << checks << " checks\n";
+    return 0;
+}
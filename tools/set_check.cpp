@@ -0,0 +1,164 @@
+// checks RegexSet after random sequences of add and remove against a DFA
+// per live pattern and against a set built fresh from the live patterns,
+// exits with 1 on the first disagreement
+
+#include "regex_set.hpp"
+
+#include <map>
+#include <random>
+
+// constants
+
+constexpr uint64_t NUM_SEQUENCES = 1500;
+constexpr uint64_t UPDATES_PER_SEQUENCE = 25;
+constexpr uint64_t CANDIDATES_PER_UPDATE = 12;
+constexpr uint64_t MAX_INITIAL_PATTERNS = 5;
+constexpr uint64_t MAX_CANDIDATE_LENGTH = 8;
+constexpr int MAX_PATTERN_DEPTH = 3;
+
+// patterns over a and b, so candidates hit their states often
+const std::vector<std::string> FIXED_PATTERNS = {
+    "", "^", "$", "^$", "^a$", "a\\$", "\\\\", "b\\\\$", "(?i)", "(?i)^a$", "(?i)b$",
+};
+
+// helpers
+
+std::string makeAtom(std::mt19937& rng, int depth) {
+    uint64_t kind = depth < MAX_PATTERN_DEPTH ? rng() % 9 : rng() % 4;
+    if (kind < 4) return std::vector<std::string>{"a", "b", ".", "[ab]"}[kind];
+
+    std::string res = makeAtom(rng, depth + 1);
+    if (kind == 4) {
+        res.insert(res.begin(), '(');
+        res += '|';
+        res += makeAtom(rng, depth + 1);
+        res += ')';
+    }
+    else if (kind == 5) res += '*';
+    else if (kind == 6) res += '+';
+    else if (kind == 7) res += '?';
+    else res += makeAtom(rng, depth + 1);
+
+    return res;
+}
+
+std::string makePattern(std::mt19937& rng) {
+    if (rng() % 6 == 0) return FIXED_PATTERNS[rng() % FIXED_PATTERNS.size()];
+
+    std::string res;
+    if (rng() % 4 == 0) res += "(?i)";
+    if (rng() % 3 == 0) res += '^';
+    res += makeAtom(rng, 0);
+    if (rng() % 3 == 0) res += '$';
+    return res;
+}
+
+std::string makeCandidate(std::mt19937& rng) {
+    std::string res(rng() % MAX_CANDIDATE_LENGTH, ' ');
+    for (char& c : res) c = "abAB$\\c"[rng() % 7];
+    return res;
+}
+
+struct Reference {
+    NFA nfa;
+    std::unique_ptr<DFA> dfa;
+};
+
+std::unique_ptr<Reference> makeReference(const std::string& pattern, Encoding encoding) {
+    auto res = std::make_unique<Reference>();
+    res->nfa = NFA(compilePostfix(pattern, encoding));
+    res->dfa = std::make_unique<DFA>(res->nfa);
+    return res;
+}
+
+void report(const std::string& what, const std::string& candidate, RegexSet& set,
+            const std::vector<uint32_t>& expected, const std::vector<uint32_t>& actual) {
+    std::cerr << what << " on \"" << candidate << "\"\n";
+    for (uint32_t id = 0; id < set.size(); id++) {
+        if (set.contains(id)) std::cerr << "    " << id << ": \"" << set.pattern(id) << "\"\n";
+    }
+
+    std::cerr << "expected:";
+    for (uint32_t id : expected) std::cerr << ' ' << id;
+    std::cerr << "\ngot:";
+    for (uint32_t id : actual) std::cerr << ' ' << id;
+    std::cerr << '\n';
+}
+
+int main() {
+    std::mt19937 rng(7);
+    uint64_t checks = 0;
+    uint64_t patched = 0;
+    uint64_t rebuilt = 0;
+
+    for (uint64_t i = 0; i < NUM_SEQUENCES; i++) {
+        bool lazy = rng() % 4 != 0;
+        Encoding encoding = rng() % 2 ? Encoding::BYTES : Encoding::UTF8;
+
+        std::vector<std::string> patterns(rng() % MAX_INITIAL_PATTERNS);
+        for (std::string& pattern : patterns) pattern = makePattern(rng);
+
+        RegexSet set(patterns, lazy, encoding);
+        std::map<uint32_t, std::unique_ptr<Reference>> live;
+        for (uint32_t id = 0; id < patterns.size(); id++) {
+            live[id] = makeReference(patterns[id], encoding);
+        }
+
+        for (uint64_t j = 0; j < UPDATES_PER_SEQUENCE; j++) {
+            // fresh ids count the live patterns in order
+            std::vector<std::string> livePatterns;
+            std::vector<uint32_t> liveIds;
+            for (auto& [id, reference] : live) {
+                livePatterns.push_back(set.pattern(id));
+                liveIds.push_back(id);
+            }
+            RegexSet fresh(livePatterns, lazy, encoding);
+
+            for (uint64_t k = 0; k < CANDIDATES_PER_UPDATE; k++) {
+                std::string candidate = makeCandidate(rng);
+
+                std::vector<uint32_t> expected;
+                for (auto& [id, reference] : live) {
+                    bool match = encoding == Encoding::BYTES
+                        ? reference->dfa->eval(ByteView(candidate))
+                        : reference->dfa->eval(UTF8View(candidate));
+                    if (match) expected.push_back(id);
+                }
+
+                std::vector<uint32_t> actual = set.eval(candidate);
+                if (actual != expected) {
+                    report("RegexSet disagrees with DFA::eval", candidate, set, expected, actual);
+                    return 1;
+                }
+
+                std::vector<uint32_t> rebuiltIds;
+                for (uint32_t id : fresh.eval(candidate)) rebuiltIds.push_back(liveIds[id]);
+                if (actual != rebuiltIds) {
+                    report("RegexSet disagrees with a fresh set", candidate, set, rebuiltIds, actual);
+                    return 1;
+                }
+
+                checks++;
+            }
+
+            SetUpdate update;
+            if (rng() % 2 && !live.empty()) {
+                auto it = std::next(live.begin(), rng() % live.size());
+                update = set.remove(it->first);
+                live.erase(it);
+            }
+            else {
+                std::string pattern = makePattern(rng);
+                update = set.add(pattern);
+                live[update.id] = makeReference(pattern, encoding);
+            }
+
+            patched += update.statesPatched;
+            rebuilt += update.rebuilt;
+        }
+    }
+
+    std::cout << "states patched: " << patched << ", rebuilds: " << rebuilt << '\n';
+    std::cout << "ok " << checks << " checks\n";
+    return 0;
+}
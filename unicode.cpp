@@ -0,0 +1,249 @@
+#include "unicode.hpp"
+
+#include <map>
+#include <mutex>
+
+CodePointTable::CodePointTable(std::span<const ClassInterval> intervals) {
+    std::map<Leaf, uint16_t> leafIdx;
+    auto it = intervals.begin();
+
+    for (uint64_t block = 0; block < NUM_BLOCKS; block++) {
+        char_t lo = block << BLOCK_BITS;
+        char_t hi = lo + (1 << BLOCK_BITS) - 1;
+        Leaf leaf = {};
+
+        while (it != intervals.end() && it->r < lo) ++it;
+
+        // intervals overlapping this block, the last one may spill over
+        for (auto curr = it; curr != intervals.end() && curr->l <= hi; ++curr) {
+            char_t l = std::max(curr->l, lo) - lo;
+            char_t r = std::min(curr->r, hi) - lo;
+            setBits(leaf.data(), l, r);
+        }
+
+        // long runs of empty or full blocks repeat the previous leaf
+        if (block && leaf == leaves[blockIdx[block - 1]]) {
+            blockIdx[block] = blockIdx[block - 1];
+            continue;
+        }
+
+        auto [entry, inserted] = leafIdx.try_emplace(leaf, leaves.size());
+        if (inserted) leaves.push_back(leaf);
+        blockIdx[block] = entry->second;
+    }
+}
+
+void negateIntervals(std::vector<ClassInterval>& intervals) {
+    std::vector<ClassInterval> res;
+    uint64_t next = 0;
+
+    for (auto [l, r] : intervals) {
+        if (l > next) res.push_back({static_cast<char_t>(next), l - 1});
+        next = static_cast<uint64_t>(r) + 1;
+    }
+
+    if (next <= MAX_CHAR) res.push_back({static_cast<char_t>(next), MAX_CHAR});
+    intervals = std::move(res);
+}
+
+bool isClassEscape(char_t c) {
+    switch (c) {
+        case 'd': case 'D':
+        case 'w': case 'W':
+        case 's': case 'S':
+            return true;
+        default:
+            return false;
+    }
+}
+
+// appends the ranges of a generated table, or of every table in a group
+static bool appendProperty(std::string_view name, std::vector<ClassInterval>& res) {
+    bool found = false;
+
+    for (size_t i = 0; i < NUM_UNICODE_PROPERTIES; i++) {
+        const UnicodeProperty& property = UNICODE_PROPERTIES[i];
+
+        // single letters name a general category group, ex. L = Lu|Ll|Lt|Lm|Lo
+        bool inGroup = name.size() == 1 && property.name.size() == 2 &&
+                       property.name[0] == name[0];
+        if (property.name != name && !inGroup) continue;
+
+        res.insert(res.end(), property.ranges, property.ranges + property.size);
+        found = true;
+    }
+
+    return found;
+}
+
+std::vector<ClassInterval> propertyRanges(std::string_view name, bool negated, bool bytes) {
+    std::vector<ClassInterval> res;
+
+    if (name == "Any") res.push_back({0, MAX_CODE_POINT});
+    else if (name == "ASCII") res.push_back({0, 0x7F});
+    else if (name == "LC" || name == "L&") {
+        appendProperty("Lu", res);
+        appendProperty("Ll", res);
+        appendProperty("Lt", res);
+    }
+    else if (name == "Cn") {
+        // unassigned is whatever no other category covers
+        for (size_t i = 0; i < NUM_UNICODE_PROPERTIES; i++) {
+            const UnicodeProperty& property = UNICODE_PROPERTIES[i];
+            if (property.name == "White_Space") continue;
+            res.insert(res.end(), property.ranges, property.ranges + property.size);
+        }
+        mergeIntervals(res);
+        negateIntervals(res);
+        res.back().r = MAX_CODE_POINT;
+    }
+    else if (!appendProperty(name, res)) {
+        throw std::runtime_error("Unknown Unicode property " + std::string(name));
+    }
+
+    // C also covers the unassigned code points
+    if (name == "C") {
+        auto unassigned = propertyRanges("Cn", false, false);
+        res.insert(res.end(), unassigned.begin(), unassigned.end());
+    }
+
+    mergeIntervals(res);
+    if (negated) negateIntervals(res);
+
+    // bytewise regexes only ever see chars up to 0xFF
+    if (bytes) {
+        std::erase_if(res, [](ClassInterval range) {return range.l > 0xFF;});
+        if (!res.empty()) res.back().r = std::min<char_t>(res.back().r, 0xFF);
+    }
+
+    return res;
+}
+
+static std::vector<ClassInterval> buildClassEscape(char_t c, bool bytes) {
+    bool negated = c == 'D' || c == 'W' || c == 'S';
+    char_t lower = negated ? c - 'A' + 'a' : c;
+    std::vector<ClassInterval> res;
+
+    // bytewise regexes use the ascii definitions
+    if (bytes) {
+        if (lower == 'd') res = {{'0', '9'}};
+        else if (lower == 'w') res = {{'0', '9'}, {'A', 'Z'}, {'_', '_'}, {'a', 'z'}};
+        else res = {{'\t', '\r'}, {' ', ' '}};
+
+        if (negated) {
+            negateIntervals(res);
+            res.back().r = 0xFF;
+        }
+        return res;
+    }
+
+    if (lower == 'd') return propertyRanges("Nd", negated, false);
+    if (lower == 's') return propertyRanges("White_Space", negated, false);
+
+    // word chars per UTS #18: letters, marks, decimal digits and connectors
+    for (std::string_view name : {"L", "M", "Nd", "Pc"}) {
+        appendProperty(name, res);
+    }
+    mergeIntervals(res);
+    if (negated) negateIntervals(res);
+
+    return res;
+}
+
+const std::vector<ClassInterval>& classEscapeRanges(char_t c, bool bytes) {
+    static constexpr std::string_view ESCAPES = "dDwWsS";
+
+    // built once, \w alone merges hundreds of intervals
+    static const auto cache = []() {
+        std::array<std::vector<ClassInterval>, 2 * ESCAPES.size()> res;
+        for (uint64_t i = 0; i < ESCAPES.size(); i++) {
+            res[i] = buildClassEscape(ESCAPES[i], false);
+            res[i + ESCAPES.size()] = buildClassEscape(ESCAPES[i], true);
+        }
+        return res;
+    }();
+
+    return cache[ESCAPES.find(static_cast<char>(c)) + (bytes ? ESCAPES.size() : 0)];
+}
+
+// adds next(c) for every c in range
+static void addFolded(ClassInterval range, bool asciiOnly, std::vector<ClassInterval>& res) {
+    static constexpr CaseFold ASCII_FOLDS[] = {{'A', 'Z', 32}, {'a', 'z', -32}};
+
+    const CaseFold* begin = asciiOnly ? ASCII_FOLDS : CASE_FOLDS;
+    const CaseFold* end = asciiOnly ? std::end(ASCII_FOLDS) : CASE_FOLDS + NUM_CASE_FOLDS;
+
+    auto it = std::lower_bound(begin, end, range.l, [](const CaseFold& fold, char_t c) {
+        return fold.hi < c;
+    });
+
+    for (; it != end && it->lo <= range.r; ++it) {
+        char_t l = std::max(range.l, it->lo);
+        char_t r = std::min(range.r, it->hi);
+
+        // the images of whole pairs, the originals are already in the set
+        if (it->delta == EVEN_ODD) {
+            l &= ~1;
+            r |= 1;
+        }
+        else if (it->delta == ODD_EVEN) {
+            if (!(l & 1)) l--;
+            if (r & 1) r++;
+        }
+        else {
+            l += it->delta;
+            r += it->delta;
+        }
+
+        res.push_back({l, r});
+    }
+}
+
+void foldIntervals(std::vector<ClassInterval>& intervals, bool asciiOnly) {
+    // orbits have at most 4 members, 3 rounds of next(c) close every one
+    for (int round = 0; round < 3; round++) {
+        uint64_t N = intervals.size();
+        for (uint64_t i = 0; i < N; i++) {
+            addFolded(intervals[i], asciiOnly, intervals);
+        }
+        mergeIntervals(intervals);
+    }
+}
+
+// tables are shared by every NFA with the same class, they are expensive to
+// build and the same few big classes (\w, \p{L}, ...) show up everywhere
+std::shared_ptr<const CodePointTable> sharedTable(std::span<const ClassInterval> intervals) {
+    struct IntervalsLess {
+        using is_transparent = void;
+
+        bool operator()(std::span<const ClassInterval> a, std::span<const ClassInterval> b) const {
+            return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end());
+        }
+    };
+
+    static std::mutex mutex;
+    static std::map<std::vector<ClassInterval>, std::weak_ptr<const CodePointTable>,
+                    IntervalsLess> tables;
+    static uint64_t sweepAt = 64;
+
+    std::lock_guard lock(mutex);
+
+    // forget classes whose NFAs are all gone
+    if (tables.size() >= sweepAt) {
+        std::erase_if(tables, [](const auto& entry) {return entry.second.expired();});
+        sweepAt = std::max<uint64_t>(64, 2 * tables.size());
+    }
+
+    auto it = tables.find(intervals);
+    if (it != tables.end()) {
+        if (auto table = it->second.lock()) return table;
+    }
+    else {
+        it = tables.emplace(std::vector(intervals.begin(), intervals.end()),
+                            std::weak_ptr<const CodePointTable>()).first;
+    }
+
+    auto table = std::make_shared<const CodePointTable>(intervals);
+    it->second = table;
+    return table;
+}
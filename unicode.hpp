@@ -0,0 +1,63 @@
+#pragma once
+
+#include "nfa.hpp"
+
+#include <string_view>
+
+// constants
+
+constexpr char_t MAX_CODE_POINT = 0x10FFFF;
+constexpr int BLOCK_BITS = 8;
+constexpr int NUM_BLOCKS = (MAX_CODE_POINT >> BLOCK_BITS) + 1;
+
+// CaseFold deltas for alternating upper/lower pairs, next(c) = c ^ 1 style
+constexpr int32_t EVEN_ODD = 1 << 30;
+constexpr int32_t ODD_EVEN = EVEN_ODD + 1;
+
+// character classes bigger than this get a CodePointTable
+constexpr uint64_t TABLE_MIN_INTERVALS = 16;
+
+// data structures
+
+struct UnicodeProperty {
+    std::string_view name;
+    const ClassInterval* ranges;
+    size_t size;
+};
+
+// chars in [lo, hi] fold to c + delta, the next member of their orbit
+struct CaseFold {
+    char_t lo, hi;
+    int32_t delta;
+};
+
+// generated in unicode_tables.cpp
+extern const UnicodeProperty UNICODE_PROPERTIES[];
+extern const size_t NUM_UNICODE_PROPERTIES;
+extern const CaseFold CASE_FOLDS[];
+extern const size_t NUM_CASE_FOLDS;
+
+// two-level bitmap: code point block -> deduplicated 256-bit leaf
+struct CodePointTable {
+    using Leaf = std::array<uint64_t, (1 << BLOCK_BITS) / 64>;
+
+    std::array<uint16_t, NUM_BLOCKS> blockIdx;
+    std::vector<Leaf> leaves;
+
+    // intervals must be sorted and merged
+    CodePointTable(std::span<const ClassInterval> intervals);
+
+    inline bool contains(char_t c) const {
+        const Leaf& leaf = leaves[blockIdx[c >> BLOCK_BITS]];
+        return (leaf[(c >> 6) & (leaf.size() - 1)] >> (c & 63)) & 1;
+    }
+};
+
+// function declarations
+
+void negateIntervals(std::vector<ClassInterval>&);
+bool isClassEscape(char_t);
+std::vector<ClassInterval> propertyRanges(std::string_view, bool negated, bool bytes);
+const std::vector<ClassInterval>& classEscapeRanges(char_t, bool bytes);
+void foldIntervals(std::vector<ClassInterval>&, bool asciiOnly);
+std::shared_ptr<const CodePointTable> sharedTable(std::span<const ClassInterval>);
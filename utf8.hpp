@@ -0,0 +1,331 @@
+#pragma once
+
+#include "simd.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// constants
+
+constexpr char32_t REPLACEMENT_CHAR = 0xFFFD;
+
+// how malformed UTF-8 is treated by UTF8View (and lone surrogates by UTF16View)
+enum class Utf8Mode : uint8_t {
+    LENIENT,    // decode whatever the lead byte announces
+    REPLACE,    // each maximal invalid subpart becomes U+FFFD
+    REJECT      // malformed candidates never match
+};
+
+// ascii runs
+
+inline size_t asciiPrefixScalar(const char* ptr, const char* end) {
+    const char* begin = ptr;
+
+    while (end - ptr >= 8) {
+        uint64_t word;
+        std::memcpy(&word, ptr, 8);
+        uint64_t high = word & 0x8080808080808080ULL;
+        if (high) return ptr - begin + (__builtin_ctzll(high) >> 3);
+        ptr += 8;
+    }
+
+    while (ptr < end && !(*ptr & 0x80)) ++ptr;
+    return ptr - begin;
+}
+
+#ifdef __SSE2__
+inline size_t asciiPrefixSse2(const char* ptr, const char* end) {
+    const char* begin = ptr;
+
+    while (end - ptr >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+        int mask = _mm_movemask_epi8(chunk);
+        if (mask) return ptr - begin + __builtin_ctz(mask);
+        ptr += 16;
+    }
+
+    return ptr - begin + asciiPrefixScalar(ptr, end);
+}
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+
+__attribute__((target("avx2")))
+inline size_t asciiPrefixAvx2(const char* ptr, const char* end) {
+    const char* begin = ptr;
+
+    while (end - ptr >= 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+        uint32_t mask = _mm256_movemask_epi8(chunk);
+        if (mask) return ptr - begin + __builtin_ctz(mask);
+        ptr += 32;
+    }
+
+    return ptr - begin + asciiPrefixSse2(ptr, end);
+}
+
+inline const bool HAS_AVX2 = []() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+}();
+#endif
+
+// number of leading bytes in [ptr, end) below 0x80
+inline size_t asciiPrefix(const char* ptr, const char* end) {
+#if defined(__x86_64__) && defined(__GNUC__)
+    if (HAS_AVX2) return asciiPrefixAvx2(ptr, end);
+#endif
+#ifdef __SSE2__
+    return asciiPrefixSse2(ptr, end);
+#else
+    return asciiPrefixScalar(ptr, end);
+#endif
+}
+
+// decoding
+
+inline bool isContinuation(uint8_t c) {
+    return (c & 0xC0) == 0x80;
+}
+
+// length of the well-formed sequence at ptr (Unicode Table 3-7), or the
+// negated length of its maximal invalid subpart
+inline int utf8SequenceLength(const char* ptr, const char* end) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(ptr);
+    ptrdiff_t avail = end - ptr;
+    uint8_t c = p[0];
+
+    if (c < 0x80) return 1;
+
+    int len;
+    uint8_t lo = 0x80, hi = 0xBF;
+
+    if (c >= 0xC2 && c <= 0xDF) len = 2;
+    else if (c >= 0xE0 && c <= 0xEF) {
+        len = 3;
+        if (c == 0xE0) lo = 0xA0;
+        if (c == 0xED) hi = 0x9F;
+    }
+    else if (c >= 0xF0 && c <= 0xF4) {
+        len = 4;
+        if (c == 0xF0) lo = 0x90;
+        if (c == 0xF4) hi = 0x8F;
+    }
+    else return -1;
+
+    // the second byte has a tighter range, the rest are plain continuations
+    if (avail < 2 || p[1] < lo || p[1] > hi) return -1;
+
+    for (int i = 2; i < len; i++) {
+        if (i >= avail || !isContinuation(p[i])) return -i;
+    }
+
+    return len;
+}
+
+// decodes the code point at ptr, storing its byte length in len
+inline char32_t decodeUtf8(const char* ptr, const char* end, int& len, Utf8Mode mode) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(ptr);
+    char32_t c = p[0];
+
+    if (c < 0x80) {
+        len = 1;
+        return c;
+    }
+
+    if (mode == Utf8Mode::LENIENT) {
+        // length announced by the lead byte, cut short by non-continuations
+        int want = (c & 0x20) == 0 ? 2 : (c & 0x10) == 0 ? 3 : (c & 0x08) == 0 ? 4 : 1;
+        if (isContinuation(c)) want = 1;
+
+        len = 1;
+        while (len < want && ptr + len < end && isContinuation(p[len])) len++;
+        if (len == 1) return c;
+
+        c &= 0x7F >> len;
+        for (int i = 1; i < len; i++) c = c << 6 | (p[i] & 0x3F);
+        return c;
+    }
+
+    len = utf8SequenceLength(ptr, end);
+    if (len < 0) {
+        len = -len;
+        return REPLACEMENT_CHAR;
+    }
+
+    c &= 0x7F >> len;
+    for (int i = 1; i < len; i++) c = c << 6 | (p[i] & 0x3F);
+    return c;
+}
+
+// validation
+
+inline bool validateUtf8(const char* ptr, const char* end) {
+    while (ptr < end) {
+        ptr += asciiPrefix(ptr, end);
+
+        // multibyte runs are validated one sequence at a time
+        while (ptr < end && (*ptr & 0x80)) {
+            int len = utf8SequenceLength(ptr, end);
+            if (len < 0) return false;
+            ptr += len;
+        }
+    }
+
+    return true;
+}
+
+// transcoding
+
+// number of code points transcodeUtf8ToUtf32 writes for [ptr, end)
+inline size_t utf32Length(const char* ptr, const char* end, Utf8Mode mode = Utf8Mode::LENIENT) {
+    size_t count = 0;
+
+    while (ptr < end) {
+        size_t ascii = asciiPrefix(ptr, end);
+        count += ascii;
+        ptr += ascii;
+
+        while (ptr < end && (*ptr & 0x80)) {
+            int len;
+            decodeUtf8(ptr, end, len, mode);
+            ptr += len;
+            count++;
+        }
+    }
+
+    return count;
+}
+
+#ifdef __SSE2__
+// widens 16 ascii bytes into 16 code points
+inline void widenAscii16(const char* src, char32_t* dst) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+    __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+
+    __m128i* out = reinterpret_cast<__m128i*>(dst);
+    _mm_storeu_si128(out, _mm_unpacklo_epi16(lo, zero));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo, zero));
+    _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi, zero));
+    _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi, zero));
+}
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+// widens the 32 ascii bytes at src, false if any of them is not ascii
+__attribute__((target("avx2")))
+inline bool widenAscii32Avx2(const char* src, char32_t* dst) {
+    __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+    if (_mm256_movemask_epi8(bytes)) return false;
+
+    __m128i lo = _mm256_castsi256_si128(bytes);
+    __m128i hi = _mm256_extracti128_si256(bytes, 1);
+
+    __m256i* out = reinterpret_cast<__m256i*>(dst);
+    _mm256_storeu_si256(out, _mm256_cvtepu8_epi32(lo));
+    _mm256_storeu_si256(out + 1, _mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8)));
+    _mm256_storeu_si256(out + 2, _mm256_cvtepu8_epi32(hi));
+    _mm256_storeu_si256(out + 3, _mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8)));
+    return true;
+}
+#endif
+
+// decodes [ptr, end) into dst, which must hold utf32Length(ptr, end, mode)
+// code points. REJECT is treated as REPLACE, validate first to reject.
+// returns the number of code points written
+inline size_t transcodeUtf8ToUtf32(const char* ptr, const char* end, char32_t* dst,
+                                   Utf8Mode mode = Utf8Mode::LENIENT) {
+    char32_t* begin = dst;
+    if (mode == Utf8Mode::REJECT) mode = Utf8Mode::REPLACE;
+
+    while (ptr < end) {
+#if defined(__x86_64__) && defined(__GNUC__)
+        if (HAS_AVX2) {
+            while (end - ptr >= 32 && widenAscii32Avx2(ptr, dst)) {
+                ptr += 32;
+                dst += 32;
+            }
+        }
+#endif
+#ifdef __SSE2__
+        while (end - ptr >= 16) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+            if (_mm_movemask_epi8(bytes)) break;
+            widenAscii16(ptr, dst);
+            ptr += 16;
+            dst += 16;
+        }
+#endif
+
+        // the ascii tail up to the next multibyte run, then the run itself
+        while (ptr < end && !(*ptr & 0x80)) *dst++ = *ptr++;
+
+        while (ptr < end && (*ptr & 0x80)) {
+            int len;
+            *dst++ = decodeUtf8(ptr, end, len, mode);
+            ptr += len;
+        }
+    }
+
+    return dst - begin;
+}
+
+// utf16, malformed input (lone surrogates) follows the same Utf8Mode rules
+
+inline bool isHighSurrogate(char16_t c) {
+    return (c & 0xFC00) == 0xD800;
+}
+
+inline bool isLowSurrogate(char16_t c) {
+    return (c & 0xFC00) == 0xDC00;
+}
+
+// decodes the code point at ptr, storing its unit length in len
+inline char32_t decodeUtf16(const char16_t* ptr, const char16_t* end, int& len, Utf8Mode mode) {
+    char32_t c = *ptr;
+    len = 1;
+
+    if ((c & 0xF800) != 0xD800) return c;
+
+    if (isHighSurrogate(c) && ptr + 1 < end && isLowSurrogate(ptr[1])) {
+        len = 2;
+        return 0x10000 + ((c - 0xD800) << 10) + (ptr[1] - 0xDC00);
+    }
+
+    // lone surrogate
+    return mode == Utf8Mode::LENIENT ? c : REPLACEMENT_CHAR;
+}
+
+inline bool validateUtf16(const char16_t* ptr, const char16_t* end) {
+    while (ptr < end) {
+#ifdef __SSE2__
+        // skip blocks without any surrogates
+        __m128i mask = _mm_set1_epi16(static_cast<short>(0xF800));
+        __m128i surrogate = _mm_set1_epi16(static_cast<short>(0xD800));
+
+        while (end - ptr >= 8) {
+            __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+            __m128i eq = _mm_cmpeq_epi16(_mm_and_si128(units, mask), surrogate);
+            if (_mm_movemask_epi8(eq)) break;
+            ptr += 8;
+        }
+#endif
+        const char16_t* stop = end - ptr > 8 ? ptr + 8 : end;
+
+        while (ptr < stop) {
+            if ((*ptr & 0xF800) != 0xD800) {
+                ptr++;
+                continue;
+            }
+            if (!isHighSurrogate(*ptr) || ptr + 1 >= end || !isLowSurrogate(ptr[1])) {
+                return false;
+            }
+            ptr += 2;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,246 @@
+#pragma once
+
+#include "utf8.hpp"
+
+#include <string>
+#include <string_view>
+#include <concepts>
+
+// constants
+
+// how candidates handed to a Regex are encoded
+enum class Encoding : uint8_t {
+    BYTES,  // every byte is one char, no decoding
+    UTF8,
+    UTF16,
+    UTF32
+};
+
+// views over encoded text, iterated one code point at a time
+
+template <typename T>
+concept CharView = requires(const T view) {
+    { *view.begin() } -> std::convertible_to<char32_t>;
+    { view.begin() != view.end() } -> std::convertible_to<bool>;
+    { view.acceptable() } -> std::convertible_to<bool>;
+    view.begin().ptr;
+};
+
+struct ByteView : public std::string_view {
+    using std::string_view::string_view;
+
+    ByteView(const std::string& s) : std::string_view(s) {}
+
+    ByteView(std::string_view s) : std::string_view(s) {}
+
+    ByteView(std::string&&) = delete;
+
+    struct Iterator {
+        const char* ptr;
+
+        char32_t operator*() const {
+            return static_cast<uint8_t>(*ptr);
+        }
+
+        Iterator& operator++() {
+            ++ptr;
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return ptr == other.ptr;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return ptr != other.ptr;
+        }
+    };
+
+    Iterator begin() const {
+        return Iterator{data()};
+    }
+
+    Iterator end() const {
+        return Iterator{data() + size()};
+    }
+
+    bool acceptable() const {
+        return true;
+    }
+
+    void pop_back() {
+        remove_suffix(1);
+    }
+};
+
+struct UTF8View : public std::string_view {
+    using std::string_view::string_view;
+
+    Utf8Mode mode = Utf8Mode::LENIENT;
+
+    UTF8View(const std::string& s, Utf8Mode mode = Utf8Mode::LENIENT)
+        : std::string_view(s), mode(mode) {}
+
+    UTF8View(std::string_view s, Utf8Mode mode = Utf8Mode::LENIENT)
+        : std::string_view(s), mode(mode) {}
+
+    UTF8View(std::string&&) = delete;
+
+    struct Iterator {
+        const char* ptr;
+        const char* end;
+        Utf8Mode mode;
+
+        inline char32_t getChar(int& numBytes) const {
+            // ascii needs no decoding
+            if (!(*ptr & 0x80)) {
+                numBytes = 1;
+                return *ptr;
+            }
+            return decodeUtf8(ptr, end, numBytes, mode);
+        }
+
+        char32_t operator*() const {
+            int numBytes;
+            return getChar(numBytes);
+        }
+
+        Iterator& operator++() {
+            int numBytes;
+            getChar(numBytes);
+            ptr += numBytes;
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return ptr == other.ptr;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return ptr != other.ptr;
+        }     
+    };
+
+    Iterator begin() const {
+        return Iterator{data(), data() + size(), mode};
+    }
+
+    Iterator end() const {
+        return Iterator{data() + size(), data() + size(), mode};
+    }
+
+    // true if the candidate may be matched at all under its mode
+    bool acceptable() const {
+        return mode != Utf8Mode::REJECT || validateUtf8(data(), data() + size());
+    }
+
+    void pop_back() {
+        remove_suffix(1);
+    }
+};
+
+struct UTF16View : public std::u16string_view {
+    using std::u16string_view::u16string_view;
+
+    Utf8Mode mode = Utf8Mode::LENIENT;
+
+    UTF16View(const std::u16string& s, Utf8Mode mode = Utf8Mode::LENIENT)
+        : std::u16string_view(s), mode(mode) {}
+
+    UTF16View(std::u16string_view s, Utf8Mode mode = Utf8Mode::LENIENT)
+        : std::u16string_view(s), mode(mode) {}
+
+    UTF16View(std::u16string&&) = delete;
+
+    struct Iterator {
+        const char16_t* ptr;
+        const char16_t* end;
+        Utf8Mode mode;
+
+        inline char32_t getChar(int& numUnits) const {
+            return decodeUtf16(ptr, end, numUnits, mode);
+        }
+
+        char32_t operator*() const {
+            int numUnits;
+            return getChar(numUnits);
+        }
+
+        Iterator& operator++() {
+            // a unit starts a pair only if it is a high surrogate
+            ptr += (isHighSurrogate(*ptr) && ptr + 1 < end && isLowSurrogate(ptr[1])) ? 2 : 1;
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return ptr == other.ptr;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return ptr != other.ptr;
+        }
+    };
+
+    Iterator begin() const {
+        return Iterator{data(), data() + size(), mode};
+    }
+
+    Iterator end() const {
+        return Iterator{data() + size(), data() + size(), mode};
+    }
+
+    bool acceptable() const {
+        return mode != Utf8Mode::REJECT || validateUtf16(data(), data() + size());
+    }
+
+    void pop_back() {
+        remove_suffix(1);
+    }
+};
+
+struct UTF32View : public std::u32string_view {
+    using std::u32string_view::u32string_view;
+
+    UTF32View(const std::u32string& s) : std::u32string_view(s) {}
+
+    UTF32View(std::u32string_view s) : std::u32string_view(s) {}
+
+    UTF32View(std::u32string&&) = delete;
+
+    struct Iterator {
+        const char32_t* ptr;
+
+        char32_t operator*() const {
+            return *ptr;
+        }
+
+        Iterator& operator++() {
+            ++ptr;
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return ptr == other.ptr;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return ptr != other.ptr;
+        }
+    };
+
+    Iterator begin() const {
+        return Iterator{data()};
+    }
+
+    Iterator end() const {
+        return Iterator{data() + size()};
+    }
+
+    bool acceptable() const {
+        return true;
+    }
+
+    void pop_back() {
+        remove_suffix(1);
+    }
+};